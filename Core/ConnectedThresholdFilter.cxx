@@ -15,13 +15,19 @@ PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
 #include "ConnectedThresholdFilter.h"
+#include "ConnectedThresholdRegionStatistics.h"
 
 #include <cassert>
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
 #include "vtkCellData.h"
 #include "vtkImageData.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkMultiThreader.h"
 #include "vtkObjectFactory.h"
 #include "vtkPolyData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
@@ -30,15 +36,244 @@ vtkStandardNewMacro(ConnectedThresholdFilter);
 
 
 //----------------------------------------------------------------------------
-ConnectedThresholdFilter::ConnectedThresholdFilter() 
+ConnectedThresholdFilter::ConnectedThresholdFilter() : Connectivity(6)
 {
   this->SetDebug(1);    
   this->SetNumberOfInputPorts(1);
-  this->SetNumberOfOutputPorts(1);
-
+  this->SetNumberOfOutputPorts(2);
+  this->UseComponentTree = 0; // every cell is labeled, see iterateOverStartingPoints
 }
 
 ConnectedThresholdFilter::~ConnectedThresholdFilter() 
 {
 }
 
+void ConnectedThresholdFilter::SetConnectivity(int connectivity)
+{
+  if(connectivity != 6 && connectivity != 18 && connectivity != 26) {
+    vtkErrorMacro(<<"Connectivity must be 6, 18 or 26, not " << connectivity);
+    return;
+  }
+  if(this->Connectivity != connectivity) {
+    this->Connectivity = connectivity;
+    this->Modified();
+  }
+}
+
+// Shared state of the labeling threads. The grid is cut into slabs of whole
+// layers, one per thread; parent is a union-find forest over cell ids in which
+// the root of a tree is its smallest cell id.
+struct ConnectedThresholdLabelJob
+{
+  enum { LABEL_SLABS, COUNT_ROOTS, NUMBER_ROOTS, NUMBER_CELLS };
+
+  int phase;
+  int dims[3];
+  const unsigned int* passes; // bit c%32 of word c/32 is set for the cells that pass the threshold
+  int* parent;
+  int* labels;
+  std::vector<int> neighbours;  // (di, dj, dk) of the neighbours that precede a cell in raster order
+  std::vector<int> slabStart;   // first layer of each slab, followed by nz
+  std::vector<int> slabLabel;   // COUNT_ROOTS: number of components rooted in the slab, then the first label
+  const ConnectedThresholdRegionSource* source;
+  std::vector<ConnectedThresholdRegionSums> sums; // of the cells of each slab
+};
+
+static inline bool labelCellPasses(const ConnectedThresholdLabelJob* job, int c)
+{
+  return ((job->passes[c >> 5] >> (c & 31)) & 1) != 0;
+}
+
+static int findLabelRoot(int* parent, int c)
+{
+  while(parent[c] != c) {
+    parent[c] = parent[parent[c]]; // path halving
+    c = parent[c];
+  }
+  return c;
+}
+
+static void uniteLabels(int* parent, int a, int b)
+{
+  a = findLabelRoot(parent, a);
+  b = findLabelRoot(parent, b);
+  if(a < b)
+    parent[b] = a;
+  else if(b < a)
+    parent[a] = b;
+}
+
+// Unites cell (i,j,k) with the preceding neighbours that pass, skipping those below layer kMin
+static void uniteWithNeighbours(ConnectedThresholdLabelJob* job, int i, int j, int k, int kMin, bool boundaryOnly)
+{
+  const int nx = job->dims[0], ny = job->dims[1];
+  const int cell = i + nx * (j + ny * k);
+  for(size_t n = 0; n < job->neighbours.size(); n += 3) {
+    const int ni = i + job->neighbours[n];
+    const int nj = j + job->neighbours[n + 1];
+    const int nk = k + job->neighbours[n + 2];
+    if(boundaryOnly && nk == k)
+      continue;
+    if(ni < 0 || ni >= nx || nj < 0 || nj >= ny || nk < kMin)
+      continue;
+    const int other = ni + nx * (nj + ny * nk);
+    if(labelCellPasses(job, other))
+      uniteLabels(job->parent, cell, other);
+  }
+}
+
+static VTK_THREAD_RETURN_TYPE labelSlabsThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  ConnectedThresholdLabelJob* job = static_cast<ConnectedThresholdLabelJob*>(info->UserData);
+  const int slab = info->ThreadID;
+  if(slab + 1 >= (int) job->slabStart.size())
+    return VTK_THREAD_RETURN_VALUE;
+
+  const int nx = job->dims[0], ny = job->dims[1];
+  const int kFirst = job->slabStart[slab];
+  const int first = nx * ny * kFirst;
+  const int last = nx * ny * job->slabStart[slab + 1];
+  int* parent = job->parent;
+
+  switch(job->phase) {
+    case ConnectedThresholdLabelJob::LABEL_SLABS:
+      // Links only lead to cells of the same slab, so no other thread writes them
+      for(int c = first; c < last; c++) {
+        if(!labelCellPasses(job, c))
+          continue;
+        parent[c] = c;
+        uniteWithNeighbours(job, c % nx, (c / nx) % ny, c / (nx * ny), kFirst, false);
+      }
+      // Roots are smaller than the cells below them, so one pass in order flattens the trees
+      for(int c = first; c < last; c++) {
+        if(labelCellPasses(job, c))
+          parent[c] = parent[parent[c]];
+      }
+      break;
+
+    case ConnectedThresholdLabelJob::COUNT_ROOTS:
+      job->slabLabel[slab] = 0;
+      for(int c = first; c < last; c++) {
+        if(labelCellPasses(job, c) && parent[c] == c)
+          job->slabLabel[slab]++;
+      }
+      break;
+
+    case ConnectedThresholdLabelJob::NUMBER_ROOTS:
+      {
+        int label = job->slabLabel[slab];
+        for(int c = first; c < last; c++) {
+          if(labelCellPasses(job, c) && parent[c] == c) {
+            job->source->add(job->sums[slab], label, c);
+            job->labels[c] = label++;
+          }
+        }
+      }
+      break;
+
+    case ConnectedThresholdLabelJob::NUMBER_CELLS:
+      // The forest is only read from now on
+      for(int c = first; c < last; c++) {
+        if(!labelCellPasses(job, c) || parent[c] == c)
+          continue;
+        int root = parent[c];
+        while(parent[root] != root)
+          root = parent[root];
+        job->labels[c] = job->labels[root];
+        job->source->add(job->sums[slab], job->labels[c], c);
+      }
+      break;
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Two pass labeling of every cell that passes the threshold. Each thread labels a
+// slab of layers with its own part of the union-find forest, then the layers on
+// both sides of each slab boundary are united (serially, they are a small part of
+// the grid). Components are numbered in the order of their first cell, which is
+// the order in which flooding from every cell numbered them. The region statistics
+// are summed per slab as the cells are numbered and merged at the end.
+void ConnectedThresholdFilter::iterateOverStartingPoints(int*rawConnectivityArray,vtkDataArray*inScalars,vtkDataArray*inScalars2, vtkDataSet*input,vtkDataSet*dataset, int autoIncrement)
+{
+  const int nx = cellDimensions[0], ny = cellDimensions[1], nz = cellDimensions[2];
+  if(!autoIncrement || nx <= 0 || ny <= 0 || nz <= 0 ||
+     (double) nx * ny * nz > (double) std::numeric_limits<int>::max()) {
+    Superclass::iterateOverStartingPoints(rawConnectivityArray, inScalars, inScalars2, input, dataset, autoIncrement);
+    return;
+  }
+  const int cells = nx * ny * nz;
+
+  std::vector<int> parent(cells, 0);
+
+  ConnectedThresholdLabelJob job;
+  job.dims[0] = nx;
+  job.dims[1] = ny;
+  job.dims[2] = nz;
+  job.passes = &passMask[0];
+  job.parent = &parent[0];
+  job.labels = rawConnectivityArray;
+  for(int dk = -1; dk <= 0; dk++) {
+    for(int dj = -1; dj <= 1; dj++) {
+      for(int di = -1; di <= 1; di++) {
+        const int order = abs(di) + abs(dj) + abs(dk); // 1 face, 2 edge, 3 corner
+        const bool precedes = dk < 0 || (dj < 0 && dk == 0) || (di < 0 && dj == 0 && dk == 0);
+        if(!precedes || (order > 1 && Connectivity == 6) || (order > 2 && Connectivity == 18))
+          continue;
+        job.neighbours.push_back(di);
+        job.neighbours.push_back(dj);
+        job.neighbours.push_back(dk);
+      }
+    }
+  }
+
+  const int threads = std::max(1, std::min(vtkMultiThreader::GetGlobalDefaultNumberOfThreads(), nz));
+  for(int t = 0; t < threads; t++)
+    job.slabStart.push_back((int) ((long long) nz * t / threads));
+  job.slabStart.push_back(nz);
+  job.slabLabel.assign(threads, 0);
+  job.source = regionSource;
+  job.sums.resize(threads);
+
+  vtkMultiThreader* threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(threads);
+  threader->SetSingleMethod(labelSlabsThread, &job);
+
+  job.phase = ConnectedThresholdLabelJob::LABEL_SLABS;
+  threader->SingleMethodExecute();
+
+  for(int t = 1; t < threads; t++) {
+    const int k = job.slabStart[t];
+    for(int j = 0; j < ny; j++) {
+      for(int i = 0; i < nx; i++) {
+        if(cellPasses(i + nx * (j + ny * k)))
+          uniteWithNeighbours(&job, i, j, k, 0, true);
+      }
+    }
+  }
+
+  job.phase = ConnectedThresholdLabelJob::COUNT_ROOTS;
+  threader->SingleMethodExecute();
+  int label = 1;
+  for(int t = 0; t < threads; t++) {
+    const int roots = job.slabLabel[t];
+    job.slabLabel[t] = label;
+    label += roots;
+  }
+  // A slab only holds labels of components rooted in it or before it
+  for(int t = 0; t < threads; t++) {
+    job.sums[t].arrays = regionSums->arrays;
+    job.sums[t].resize((t + 1 < threads ? job.slabLabel[t + 1] : label) - 1);
+  }
+  job.phase = ConnectedThresholdLabelJob::NUMBER_ROOTS;
+  threader->SingleMethodExecute();
+  job.phase = ConnectedThresholdLabelJob::NUMBER_CELLS;
+  threader->SingleMethodExecute();
+  threader->Delete();
+
+  regionSums->resize(label - 1);
+  for(int t = 0; t < threads; t++)
+    regionSums->merge(job.sums[t]);
+
+  vtkDebugMacro(<<"Labeled " << (label - 1) << " regions with " << threads << " threads");
+}
@@ -35,10 +35,21 @@ public:
   static ConnectedThresholdFilter *New();
   vtkTypeMacro(ConnectedThresholdFilter,ConnectedThresholdWithCustomSourceFilter);
 
+  // Description:
+  // Cells are connected through their faces (6), faces and edges (18) or
+  // faces, edges and corners (26). The default is 6.
+  void SetConnectivity(int connectivity);
+  vtkGetMacro(Connectivity, int);
+
 protected: 
   ConnectedThresholdFilter();
   virtual ~ConnectedThresholdFilter();
 
+  // Labels every connected region, the points of the input are not used as seeds
+  virtual void iterateOverStartingPoints(int*rawConnectivityArray,vtkDataArray*inScalars,vtkDataArray*inScalars2, vtkDataSet*input,vtkDataSet*dataset, int autoIncrement);
+
+  int Connectivity;
+
 private:
   ConnectedThresholdFilter(const ConnectedThresholdFilter&);  // Not implemented.
   void operator=(const ConnectedThresholdFilter&);  // Not implemented.
@@ -0,0 +1,61 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    ConnectedThresholdRegionStatistics
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Li, D McWherter, R Reizner
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+// Private to ConnectedThresholdWithCustomSourceFilter and ConnectedThresholdFilter,
+// not installed or wrapped.
+
+#ifndef __ConnectedThresholdRegionStatistics_h
+#define __ConnectedThresholdRegionStatistics_h
+
+#include "vtkType.h"
+#include <vector>
+
+class vtkDataArray;
+class vtkPoints;
+
+// Sums over the cells of each labelled region, label l at index l-1. They are
+// added up while the cells are painted, so the statistics table (the second
+// output) needs no second pass over the grid.
+struct ConnectedThresholdRegionSums
+{
+  int arrays;                 // number of statistics arrays
+  std::vector<vtkIdType> cells;
+  std::vector<double> volume;
+  std::vector<int> box;       // i, j and k min and max, 6 per label
+  std::vector<double> center; // sum of the cell centers, 3 per label
+  std::vector<double> values; // sum of each statistics array, arrays per label
+
+  ConnectedThresholdRegionSums() : arrays(0) {}
+  void resize(int labels);
+  void merge(const ConnectedThresholdRegionSums& other);
+};
+
+// Where the sums of a cell come from. add() only reads it, so the labeling
+// threads share one.
+struct ConnectedThresholdRegionSource
+{
+  int dims[3];                       // cells along i, j and k
+  vtkDataArray* volume;              // Cell_Volume of the input, NULL if it has none
+  std::vector<vtkDataArray*> arrays; // statistics arrays
+  std::vector<double> centers[3];    // cell centers along each axis (image data, rectilinear grids)
+  vtkPoints* points;                 // points of a structured grid
+
+  ConnectedThresholdRegionSource() : volume(NULL), points(NULL) {}
+  void add(ConnectedThresholdRegionSums& sums, int label, vtkIdType cellId) const;
+};
+
+#endif
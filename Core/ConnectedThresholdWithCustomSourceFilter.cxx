@@ -15,17 +15,26 @@ PURPOSE.  See the above copyright notice for more information.
 
 =========================================================================*/
 #include "ConnectedThresholdWithCustomSourceFilter.h"
+#include "ConnectedThresholdRegionStatistics.h"
 
 #include <cassert>
 
+#include <algorithm>
+#include <limits>
+
 #include "vtkCellData.h"
+#include "vtkDoubleArray.h"
+#include "vtkIdTypeArray.h"
 #include "vtkImageData.h"
+#include "vtkIntArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkStructuredGrid.h"
+#include "vtkTable.h"
 #include "vtkCellLocator.h"
 vtkStandardNewMacro(ConnectedThresholdWithCustomSourceFilter);
 
@@ -34,14 +43,28 @@ vtkStandardNewMacro(ConnectedThresholdWithCustomSourceFilter);
 #define SGRID (2)
 #define RGRID (3)
 
+// SSE2 is part of every x86-64 target, other builds use the scalar kernel only
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RVA_THRESHOLD_SSE2
+#endif
+
 //----------------------------------------------------------------------------
 ConnectedThresholdWithCustomSourceFilter::ConnectedThresholdWithCustomSourceFilter() :
 RVAArrayName(""), ResultArrayName("Connectivity"),cellLocator(NULL)//, Output(NULL)
 {
   this->SetDebug(1);    
   this->SetNumberOfInputPorts(2);
-  this->SetNumberOfOutputPorts(1); 
+  this->SetNumberOfOutputPorts(2); // the labelled grid and the statistics of its regions
   this->isImageData = true;
+  this->passMaskKey.cells = -1;
+  this->UseComponentTree = 1;
+  this->treeActive = false;
+  this->componentTree.array = NULL;
+  this->componentTree.arrayTime = 0;
+  this->componentTree.direction = 0;
+  this->regionSource = new ConnectedThresholdRegionSource;
+  this->regionSums = new ConnectedThresholdRegionSums;
 }
 
 //----------------------------------------------------------------------------
@@ -50,6 +73,8 @@ ConnectedThresholdWithCustomSourceFilter::~ConnectedThresholdWithCustomSourceFil
 	if(cellLocator)
 		cellLocator->Delete();
 	cellLocator = NULL;
+  delete regionSource;
+  delete regionSums;
 }
 
 int ConnectedThresholdWithCustomSourceFilter::RequestUpdateExtent (
@@ -66,6 +91,32 @@ int ConnectedThresholdWithCustomSourceFilter::RequestUpdateExtent (
   return 1;
 }
 
+int ConnectedThresholdWithCustomSourceFilter::FillOutputPortInformation(int port, vtkInformation* info)
+{
+  if(port == 1) {
+    info->Set(vtkDataObject::DATA_TYPE_NAME(), "vtkTable");
+    return 1;
+  }
+  return this->Superclass::FillOutputPortInformation(port, info);
+}
+
+// The superclass gives every port an instance of the input type, the second one is a table
+int ConnectedThresholdWithCustomSourceFilter::RequestDataObject(vtkInformation* request,
+                                                 vtkInformationVector** inputVector,
+                                                 vtkInformationVector* outputVector)
+{
+  if(!this->Superclass::RequestDataObject(request, inputVector, outputVector))
+    return 0;
+  vtkInformation* info = outputVector->GetInformationObject(1);
+  if(!vtkTable::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT()))) {
+    vtkTable* table = vtkTable::New();
+    table->SetPipelineInformation(info);
+    table->Delete();
+    this->GetOutputPortInformation(1)->Set(vtkDataObject::DATA_EXTENT_TYPE(), table->GetExtentType());
+  }
+  return 1;
+}
+
 int ConnectedThresholdWithCustomSourceFilter::RequestInformation(vtkInformation*  request ,
                                                  vtkInformationVector** inputVector,
                                                  vtkInformationVector* outputVector)
@@ -141,6 +192,11 @@ int ConnectedThresholdWithCustomSourceFilter::RequestData(vtkInformation *vtkNot
   if(!doThreshold(outInfo, genericInput, output, input2, inScalars, inScalars2))
     return 0;
 
+  vtkTable* table = vtkTable::SafeDownCast(
+    outputVector->GetInformationObject(1)->Get(vtkDataObject::DATA_OBJECT()));
+  if(table)
+    fillStatisticsTable(table);
+
   return 1;
 }
 
@@ -166,6 +222,10 @@ int ConnectedThresholdWithCustomSourceFilter::doThreshold(vtkInformation* outInf
     return 0;
   }
 
+  treeActive = updateComponentTree(inScalars, inScalars2);
+  if(!treeActive && !updatePassMask(inScalars, inScalars2))
+    return 0;
+
   vtkIntArray* arr  = vtkIntArray::New();
 
   arr->SetNumberOfValues(requiredNumTupes);
@@ -183,6 +243,7 @@ int ConnectedThresholdWithCustomSourceFilter::doThreshold(vtkInformation* outInf
 
  
   GetExtent(input, extent);
+  prepareRegionStatistics(input);
 
 	if(input2!=NULL)
 		iterateOverStartingPoints(rawConnectivityArray,inScalars,inScalars2,input, input2,false /*always paint with 1 */);
@@ -217,12 +278,230 @@ void ConnectedThresholdWithCustomSourceFilter::iterateOverStartingPoints(int*raw
     dataset->GetPoint(i, point);
     if (ComputeStructuredCoordinates(input, point, ijk, pcoords,extent))
     {
-      vtkIdType result = executeConnectivity(inScalars, inScalars2, rawConnectivityArray, ijk[0],ijk[1],ijk[2],paint);      
+      vtkIdType result = executeConnectivity(rawConnectivityArray, ijk[0],ijk[1],ijk[2],paint);      
       if(autoIncrement && result != 0) paint ++;
 		}
   }
 }
 
+void ConnectedThresholdWithCustomSourceFilter::AddStatisticsArray(const char* name)
+{
+  if(name && *name) {
+    StatisticsArrays.push_back(name);
+    this->Modified();
+  }
+}
+
+void ConnectedThresholdWithCustomSourceFilter::RemoveAllStatisticsArrays()
+{
+  if(!StatisticsArrays.empty()) {
+    StatisticsArrays.clear();
+    this->Modified();
+  }
+}
+
+void ConnectedThresholdRegionSums::resize(int labels)
+{
+  const int old = (int) cells.size();
+  if(labels <= old)
+    return;
+  cells.resize(labels, 0);
+  volume.resize(labels, 0.0);
+  box.reserve(6 * labels);
+  for(int l = old; l < labels; l++) {
+    for(int d = 0; d < 3; d++) {
+      box.push_back(std::numeric_limits<int>::max());
+      box.push_back(std::numeric_limits<int>::min());
+    }
+  }
+  center.resize(3 * labels, 0.0);
+  values.resize((size_t) arrays * labels, 0.0);
+}
+
+void ConnectedThresholdRegionSums::merge(const ConnectedThresholdRegionSums& other)
+{
+  const int labels = (int) other.cells.size();
+  resize(labels);
+  for(int l = 0; l < labels; l++) {
+    if(other.cells[l] == 0)
+      continue;
+    cells[l] += other.cells[l];
+    volume[l] += other.volume[l];
+    for(int d = 0; d < 6; d += 2) {
+      box[6 * l + d] = std::min(box[6 * l + d], other.box[6 * l + d]);
+      box[6 * l + d + 1] = std::max(box[6 * l + d + 1], other.box[6 * l + d + 1]);
+    }
+    for(int d = 0; d < 3; d++)
+      center[3 * l + d] += other.center[3 * l + d];
+    for(int a = 0; a < arrays; a++)
+      values[(size_t) l * arrays + a] += other.values[(size_t) l * arrays + a];
+  }
+}
+
+void ConnectedThresholdRegionSource::add(ConnectedThresholdRegionSums& sums, int label, vtkIdType cellId) const
+{
+  const int l = label - 1;
+  if(l >= (int) sums.cells.size())
+    sums.resize(label);
+  const int ijk[3] = { (int) (cellId % dims[0]), (int) ((cellId / dims[0]) % dims[1]),
+                       (int) (cellId / ((vtkIdType) dims[0] * dims[1])) };
+
+  sums.cells[l]++;
+  if(volume)
+    sums.volume[l] += volume->GetComponent(cellId, 0);
+  int* box = &sums.box[6 * l];
+  double* center = &sums.center[3 * l];
+  for(int d = 0; d < 3; d++) {
+    box[2 * d] = std::min(box[2 * d], ijk[d]);
+    box[2 * d + 1] = std::max(box[2 * d + 1], ijk[d]);
+  }
+  if(points) {
+    // mean of the corners of the hexahedron
+    const vtkIdType px = dims[0] + 1;
+    const vtkIdType pxy = px * (dims[1] + 1);
+    double corner[3];
+    for(int c = 0; c < 8; c++) {
+      points->GetPoint((ijk[0] + (c & 1)) + px * (ijk[1] + ((c >> 1) & 1)) + pxy * (ijk[2] + (c >> 2)), corner);
+      for(int d = 0; d < 3; d++)
+        center[d] += corner[d] / 8;
+    }
+  }
+  else if(!centers[0].empty()) {
+    for(int d = 0; d < 3; d++)
+      center[d] += centers[d][ijk[d]];
+  }
+  for(int a = 0; a < sums.arrays; a++)
+    sums.values[(size_t) l * sums.arrays + a] += arrays[a]->GetComponent(cellId, 0);
+}
+
+void ConnectedThresholdWithCustomSourceFilter::prepareRegionStatistics(vtkDataSet* input)
+{
+  ConnectedThresholdRegionSource& source = *regionSource;
+  const vtkIdType cells = (vtkIdType) cellDimensions[0] * cellDimensions[1] * cellDimensions[2];
+  for(int d = 0; d < 3; d++) {
+    source.dims[d] = cellDimensions[d];
+    source.centers[d].clear();
+  }
+  source.volume = input->GetCellData()->GetArray("Cell_Volume");
+  if(source.volume && source.volume->GetNumberOfTuples() != cells)
+    source.volume = NULL;
+  source.arrays.clear();
+  for(size_t a = 0; a < StatisticsArrays.size(); a++) {
+    vtkDataArray* array = input->GetCellData()->GetArray(StatisticsArrays[a]);
+    if(!array || array->GetNumberOfTuples() != cells) {
+      vtkWarningMacro(<<"No cell array " << StatisticsArrays[a] << " for the region statistics");
+      continue;
+    }
+    source.arrays.push_back(array);
+  }
+
+  source.points = NULL;
+  vtkImageData* imd = vtkImageData::SafeDownCast(input);
+  vtkRectilinearGrid* rgrid = vtkRectilinearGrid::SafeDownCast(input);
+  vtkStructuredGrid* sgrid = vtkStructuredGrid::SafeDownCast(input);
+  if(imd != NULL) {
+    const double* origin = imd->GetOrigin();
+    const double* spacing = imd->GetSpacing();
+    for(int d = 0; d < 3; d++) {
+      for(int i = 0; i < cellDimensions[d]; i++)
+        source.centers[d].push_back(origin[d] + (extent[2 * d] + i + 0.5) * spacing[d]);
+    }
+  }
+  else if(rgrid != NULL) {
+    vtkDataArray* coordinates[3] = { rgrid->GetXCoordinates(), rgrid->GetYCoordinates(), rgrid->GetZCoordinates() };
+    for(int d = 0; d < 3; d++) {
+      for(int i = 0; i < cellDimensions[d]; i++)
+        source.centers[d].push_back(0.5 * (coordinates[d]->GetComponent(i, 0) + coordinates[d]->GetComponent(i + 1, 0)));
+    }
+  }
+  else if(sgrid != NULL)
+    source.points = sgrid->GetPoints();
+
+  *regionSums = ConnectedThresholdRegionSums();
+  regionSums->arrays = (int) source.arrays.size();
+}
+
+// One row per label, from the sums of its cells
+void ConnectedThresholdWithCustomSourceFilter::fillStatisticsTable(vtkTable* table)
+{
+  const ConnectedThresholdRegionSums& sums = *regionSums;
+  const int labels = (int) sums.cells.size();
+  const int arrays = sums.arrays;
+
+  vtkIntArray* label = vtkIntArray::New();
+  label->SetName("Label");
+  label->SetNumberOfTuples(labels);
+  vtkIdTypeArray* cells = vtkIdTypeArray::New();
+  cells->SetName("Cells");
+  cells->SetNumberOfTuples(labels);
+  vtkDoubleArray* volume = NULL;
+  if(regionSource->volume) {
+    volume = vtkDoubleArray::New();
+    volume->SetName("Volume");
+    volume->SetNumberOfTuples(labels);
+  }
+  const char* boxNames[6] = { "IMin", "IMax", "JMin", "JMax", "KMin", "KMax" };
+  vtkIntArray* box[6];
+  for(int d = 0; d < 6; d++) {
+    box[d] = vtkIntArray::New();
+    box[d]->SetName(boxNames[d]);
+    box[d]->SetNumberOfTuples(labels);
+  }
+  vtkDoubleArray* centroid = vtkDoubleArray::New();
+  centroid->SetName("Centroid");
+  centroid->SetNumberOfComponents(3);
+  centroid->SetNumberOfTuples(labels);
+  std::vector<vtkDoubleArray*> sum(arrays), mean(arrays);
+  for(int a = 0; a < arrays; a++) {
+    const vtkStdString name = regionSource->arrays[a]->GetName() ? regionSource->arrays[a]->GetName() : "";
+    sum[a] = vtkDoubleArray::New();
+    sum[a]->SetName((name + "_Sum").c_str());
+    sum[a]->SetNumberOfTuples(labels);
+    mean[a] = vtkDoubleArray::New();
+    mean[a]->SetName((name + "_Mean").c_str());
+    mean[a]->SetNumberOfTuples(labels);
+  }
+
+  for(int l = 0; l < labels; l++) {
+    const vtkIdType count = sums.cells[l];
+    const double scale = count > 0 ? 1.0 / count : 0.0;
+    label->SetValue(l, l + 1);
+    cells->SetValue(l, count);
+    if(volume)
+      volume->SetValue(l, sums.volume[l]);
+    for(int d = 0; d < 6; d++)
+      box[d]->SetValue(l, count > 0 ? sums.box[6 * l + d] : 0);
+    for(int d = 0; d < 3; d++)
+      centroid->SetComponent(l, d, sums.center[3 * l + d] * scale);
+    for(int a = 0; a < arrays; a++) {
+      const double value = sums.values[(size_t) l * arrays + a];
+      sum[a]->SetValue(l, value);
+      mean[a]->SetValue(l, value * scale);
+    }
+  }
+
+  table->AddColumn(label);
+  label->Delete();
+  table->AddColumn(cells);
+  cells->Delete();
+  if(volume) {
+    table->AddColumn(volume);
+    volume->Delete();
+  }
+  for(int d = 0; d < 6; d++) {
+    table->AddColumn(box[d]);
+    box[d]->Delete();
+  }
+  table->AddColumn(centroid);
+  centroid->Delete();
+  for(int a = 0; a < arrays; a++) {
+    table->AddColumn(sum[a]);
+    sum[a]->Delete();
+    table->AddColumn(mean[a]);
+    mean[a]->Delete();
+  }
+}
+
 void ConnectedThresholdWithCustomSourceFilter::SetRVAArrayName(int a, int b, int c, int d, vtkStdString array)
 {
   RVAArrayName=array;
@@ -233,26 +512,417 @@ void ConnectedThresholdWithCustomSourceFilter::SetRVAArrayName2(int a, int b, in
   RVAArrayName2=array;
 }
 
-vtkIdType ConnectedThresholdWithCustomSourceFilter::executeConnectivity(vtkDataArray* data, vtkDataArray* data2, int* connectivity, int i, int j, int k, int numb) {
-	if(i<0 || j<0 ||k<0 || i>= cellDimensions[0] || j>= cellDimensions[1] || k>=cellDimensions[2])
+// Sets bit c%32 of bits[c/32] for the values (component 0 of stride) in [lower, upper].
+// The comparison is done in double like Between, so NaN never passes.
+template <class T>
+static void thresholdValues(const T* values, vtkIdType n, int stride, double lower, double upper, unsigned int* bits)
+{
+  for(vtkIdType first = 0; first < n; first += 32) {
+    const int count = (int) std::min<vtkIdType>(32, n - first);
+    const T* v = values + first * stride;
+    unsigned int word = 0;
+    for(int b = 0; b < count; b++) {
+      const double s = static_cast<double>(v[b * stride]);
+      word |= (unsigned int) (s >= lower && s <= upper) << b;
+    }
+    bits[first / 32] = word;
+  }
+}
+
+#ifdef RVA_THRESHOLD_SSE2
+// Two doubles per compare; the partial word at the end goes to the scalar kernel
+static void thresholdValues(const double* values, vtkIdType n, int stride, double lower, double upper, unsigned int* bits)
+{
+  if(stride != 1) {
+    thresholdValues<double>(values, n, stride, lower, upper, bits);
+    return;
+  }
+  const __m128d lo = _mm_set1_pd(lower);
+  const __m128d hi = _mm_set1_pd(upper);
+  const vtkIdType words = n / 32;
+  for(vtkIdType w = 0; w < words; w++) {
+    const double* v = values + w * 32;
+    unsigned int word = 0;
+    for(int b = 0; b < 32; b += 2) {
+      const __m128d x = _mm_loadu_pd(v + b);
+      const __m128d in = _mm_and_pd(_mm_cmpge_pd(x, lo), _mm_cmple_pd(x, hi));
+      word |= (unsigned int) _mm_movemask_pd(in) << b;
+    }
+    bits[w] = word;
+  }
+  if(words * 32 < n)
+    thresholdValues<double>(values + words * 32, n - words * 32, 1, lower, upper, bits + words);
+}
+
+// Four floats per load, widened to double so the thresholds are not rounded
+static void thresholdValues(const float* values, vtkIdType n, int stride, double lower, double upper, unsigned int* bits)
+{
+  if(stride != 1) {
+    thresholdValues<float>(values, n, stride, lower, upper, bits);
+    return;
+  }
+  const __m128d lo = _mm_set1_pd(lower);
+  const __m128d hi = _mm_set1_pd(upper);
+  const vtkIdType words = n / 32;
+  for(vtkIdType w = 0; w < words; w++) {
+    const float* v = values + w * 32;
+    unsigned int word = 0;
+    for(int b = 0; b < 32; b += 4) {
+      const __m128 x = _mm_loadu_ps(v + b);
+      const __m128d low = _mm_cvtps_pd(x);
+      const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+      const __m128d inLow = _mm_and_pd(_mm_cmpge_pd(low, lo), _mm_cmple_pd(low, hi));
+      const __m128d inHigh = _mm_and_pd(_mm_cmpge_pd(high, lo), _mm_cmple_pd(high, hi));
+      word |= (unsigned int) (_mm_movemask_pd(inLow) | (_mm_movemask_pd(inHigh) << 2)) << b;
+    }
+    bits[w] = word;
+  }
+  if(words * 32 < n)
+    thresholdValues<float>(values + words * 32, n - words * 32, 1, lower, upper, bits + words);
+}
+#endif
+
+// Dispatches on the native type of the array, so no value goes through GetComponent
+static bool thresholdArray(vtkDataArray* array, vtkIdType n, double lower, double upper, unsigned int* bits)
+{
+  void* values = array->GetVoidPointer(0);
+  const int stride = array->GetNumberOfComponents();
+  switch(array->GetDataType()) {
+    vtkTemplateMacro(thresholdValues(static_cast<VTK_TT*>(values), n, stride, lower, upper, bits));
+    default:
+      return false;
+  }
+  return true;
+}
+
+bool ConnectedThresholdWithCustomSourceFilter::updatePassMask(vtkDataArray* data, vtkDataArray* data2)
+{
+  PassMaskKey key;
+  key.arrays[0] = data;
+  key.arrays[1] = data2;
+  key.arrayTimes[0] = data->GetMTime();
+  key.arrayTimes[1] = data2->GetMTime();
+  key.thresholds[0] = LowerThreshold;
+  key.thresholds[1] = UpperThreshold;
+  key.thresholds[2] = LowerThreshold2;
+  key.thresholds[3] = UpperThreshold2;
+  key.insideOut[0] = InsideOut;
+  key.insideOut[1] = InsideOut2;
+  key.mode = Mode;
+  key.cells = data->GetNumberOfTuples();
+
+  const PassMaskKey& old = passMaskKey;
+  if(old.cells == key.cells && old.mode == key.mode &&
+     std::equal(key.arrays, key.arrays + 2, old.arrays) &&
+     std::equal(key.arrayTimes, key.arrayTimes + 2, old.arrayTimes) &&
+     std::equal(key.thresholds, key.thresholds + 4, old.thresholds) &&
+     std::equal(key.insideOut, key.insideOut + 2, old.insideOut)) {
+    vtkDebugMacro(<<"Reusing the threshold of " << key.cells << " cells");
+    return true;
+  }
+  passMaskKey.cells = -1;
+  if(key.cells <= 0) {
+    passMask.clear();
+    passMaskKey = key;
+    return true;
+  }
+
+  // Mode 0: both ranges, 1: either range, 2: first range only, 3: second range only
+  const vtkIdType n = key.cells;
+  const size_t words = (size_t) ((n + 31) / 32);
+  std::vector<unsigned int> second;
+  passMask.assign(words, 0);
+  if(Mode != 3 && !thresholdArray(data, n, LowerThreshold, UpperThreshold, &passMask[0])) {
+    vtkErrorMacro(<<"Unsupported type of array " << data->GetName() << ": " << data->GetDataTypeAsString());
+    return false;
+  }
+  if(Mode != 2) {
+    second.assign(words, 0);
+    if(!thresholdArray(data2, n, LowerThreshold2, UpperThreshold2, &second[0])) {
+      vtkErrorMacro(<<"Unsupported type of array " << data2->GetName() << ": " << data2->GetDataTypeAsString());
+      return false;
+    }
+  }
+
+  const unsigned int flip = InsideOut ? ~0u : 0u;
+  const unsigned int flip2 = InsideOut2 ? ~0u : 0u;
+  for(size_t w = 0; w < words; w++) {
+    const unsigned int a = passMask[w] ^ flip;
+    const unsigned int b = (Mode != 2) ? second[w] ^ flip2 : 0u;
+    passMask[w] = (Mode == 0) ? a & b : (Mode == 1) ? a | b : (Mode == 2) ? a : b;
+  }
+  if(n % 32)
+    passMask[words - 1] &= (1u << (n % 32)) - 1; // no cells past the end
+
+  passMaskKey = key;
+  return true;
+}
+
+// Orders cells by value for the component tree
+template <class T>
+struct ComponentTreeLess
+{
+  const T* values;
+  int stride;
+  bool operator()(int a, int b) const { return values[(vtkIdType) a * stride] < values[(vtkIdType) b * stride]; }
+};
+
+template <class T>
+static void sortTreeCells(const T* values, int n, int stride, std::vector<int>& order)
+{
+  order.clear();
+  order.reserve(n);
+  for(int c = 0; c < n; c++) {
+    const double v = static_cast<double>(values[(vtkIdType) c * stride]);
+    if(v == v) // NaN is in no region
+      order.push_back(c);
+  }
+  ComponentTreeLess<T> less;
+  less.values = values;
+  less.stride = stride;
+  std::sort(order.begin(), order.end(), less);
+}
+
+static int findTreeRoot(std::vector<int>& zpar, int c)
+{
+  while(zpar[c] != c) {
+    zpar[c] = zpar[zpar[c]]; // path halving
+    c = zpar[c];
+  }
+  return c;
+}
+
+bool ConnectedThresholdWithCustomSourceFilter::updateComponentTree(vtkDataArray* data, vtkDataArray* data2)
+{
+  // Only a single range that is not inverted is the level set of one array
+  if(!UseComponentTree || (Mode != 2 && Mode != 3))
+    return false;
+  vtkDataArray* array = (Mode == 2) ? data : data2;
+  const bool insideOut = (Mode == 2) ? InsideOut : InsideOut2;
+  const double lower = (Mode == 2) ? LowerThreshold : LowerThreshold2;
+  const double upper = (Mode == 2) ? UpperThreshold : UpperThreshold2;
+  const vtkIdType tuples = array->GetNumberOfTuples();
+  if(insideOut || tuples <= 0 || tuples > std::numeric_limits<int>::max())
+    return false;
+  const int n = (int) tuples;
+
+  ComponentTree& tree = componentTree;
+  if(tree.array != array || tree.arrayTime != array->GetMTime() || tree.node.size() != (size_t) n) {
+    tree.array = NULL;
+    tree.direction = 0;
+    tree.node.clear();
+    tree.layout.clear();
+    tree.parent.clear();
+    tree.first.clear();
+    tree.own.clear();
+    tree.end.clear();
+    void* values = array->GetVoidPointer(0);
+    const int stride = array->GetNumberOfComponents();
+    switch(array->GetDataType()) {
+      vtkTemplateMacro(sortTreeCells(static_cast<VTK_TT*>(values), n, stride, tree.order));
+      default:
+        tree.order.clear();
+        return false;
+    }
+    tree.array = array;
+    tree.arrayTime = array->GetMTime();
+    tree.node.assign(n, -1);
+  }
+  if(tree.order.empty())
+    return false;
+
+  // A max-tree answers ranges that reach the highest value, a min-tree those that reach the lowest
+  const bool toMax = upper >= array->GetComponent(tree.order.back(), 0);
+  const bool toMin = lower <= array->GetComponent(tree.order.front(), 0);
+  int direction = toMax ? 1 : toMin ? -1 : 0;
+  if(toMax && toMin && tree.direction != 0)
+    direction = tree.direction; // either tree will do
+  if(direction == 0)
+    return false;
+  if(direction == tree.direction)
+    return true;
+
+  const int nx = cellDimensions[0], ny = cellDimensions[1], nz = cellDimensions[2];
+  if((vtkIdType) nx * ny * nz != tuples)
+    return false;
+  const int sliceSize = nx * ny;
+  const int count = (int) tree.order.size();
+  std::vector<int> zpar(n, -1); // union-find over the cells added so far, the root is the last one added
+  tree.parent.clear();
+  for(int o = 0; o < count; o++) {
+    const int c = tree.order[direction > 0 ? count - 1 - o : o];
+    zpar[c] = c;
+    const int i = c % nx, j = (c / nx) % ny, k = c / sliceSize;
+    const int neighbours[6] = { i > 0 ? c - 1 : -1, i < nx - 1 ? c + 1 : -1,
+                                j > 0 ? c - nx : -1, j < ny - 1 ? c + nx : -1,
+                                k > 0 ? c - sliceSize : -1, k < nz - 1 ? c + sliceSize : -1 };
+    int joined[6];
+    int regions = 0;
+    for(int m = 0; m < 6; m++) {
+      if(neighbours[m] < 0 || zpar[neighbours[m]] < 0)
+        continue;
+      const int root = findTreeRoot(zpar, neighbours[m]);
+      if(root == c)
+        continue;
+      zpar[root] = c;
+      joined[regions++] = tree.node[root]; // the last cell of a region is in its top node
+    }
+    if(regions == 1) {
+      tree.node[c] = joined[0];
+      continue;
+    }
+    const int created = (int) tree.parent.size();
+    tree.parent.push_back(-1);
+    tree.node[c] = created;
+    for(int m = 0; m < regions; m++)
+      tree.parent[joined[m]] = created;
+  }
+  zpar.clear();
+
+  // Children are created before their parent, so sizes accumulate in one pass up
+  // and subtrees are placed in one pass down
+  const int nodes = (int) tree.parent.size();
+  std::vector<int> ownCount(nodes, 0);
+  std::vector<int> size(nodes, 0);
+  std::vector<int> cursor(nodes, 0);
+  for(int o = 0; o < count; o++)
+    ownCount[tree.node[tree.order[o]]]++;
+  for(int m = 0; m < nodes; m++) {
+    size[m] += ownCount[m];
+    if(tree.parent[m] >= 0)
+      size[tree.parent[m]] += size[m];
+  }
+  tree.first.assign(nodes, 0);
+  tree.own.assign(nodes, 0);
+  tree.end.assign(nodes, 0);
+  int placed = 0;
+  for(int m = nodes - 1; m >= 0; m--) {
+    int& start = (tree.parent[m] >= 0) ? cursor[tree.parent[m]] : placed;
+    tree.first[m] = start;
+    start += size[m];
+    cursor[m] = tree.first[m];
+    tree.own[m] = tree.first[m] + size[m] - ownCount[m];
+    tree.end[m] = tree.first[m] + size[m];
+  }
+  tree.layout.assign(count, -1);
+  cursor = tree.own;
+  for(int o = 0; o < count; o++) {
+    const int c = tree.order[direction > 0 ? count - 1 - o : o];
+    tree.layout[cursor[tree.node[c]]++] = c;
+  }
+  tree.direction = direction;
+  vtkDebugMacro(<<"Built the " << (direction > 0 ? "max" : "min") << "-tree of " << count << " cells, " << nodes << " nodes");
+  return true;
+}
+
+// The region of the seed starts at its highest node that passes, only the cells of
+// the region and the nodes on the way up are visited
+vtkIdType ConnectedThresholdWithCustomSourceFilter::paintTreeRegion(int* connectivity, int seed, int paint)
+{
+  const ComponentTree& tree = componentTree;
+  const bool first = (Mode == 2);
+  const double value = tree.array->GetComponent(seed, 0);
+  if(!(first ? Between(value) : Between2(value)) || connectivity[seed] != 0)
+    return 0; // outside the range, or painted with the region of an earlier seed
+
+  const double lower = first ? LowerThreshold : LowerThreshold2;
+  const double upper = first ? UpperThreshold : UpperThreshold2;
+  int top = tree.node[seed];
+  while(tree.parent[top] >= 0) {
+    const double v = tree.array->GetComponent(tree.layout[tree.own[tree.parent[top]]], 0);
+    if(tree.direction > 0 ? v < lower : v > upper)
+      break;
+    top = tree.parent[top];
+  }
+
+  // Every cell below the node passes, its own cells pass up to the threshold
+  int last = tree.own[top];
+  while(last < tree.end[top]) {
+    const double v = tree.array->GetComponent(tree.layout[last], 0);
+    if(tree.direction > 0 ? v < lower : v > upper)
+      break;
+    last++;
+  }
+  for(int l = tree.first[top]; l < last; l++) {
+    connectivity[tree.layout[l]] = paint;
+    regionSource->add(*regionSums, paint, tree.layout[l]);
+  }
+  return last - tree.first[top];
+}
+
+// Paints a cell that passes the threshold and is not painted already
+bool ConnectedThresholdWithCustomSourceFilter::claimCell(int* connectivity, vtkIdType cellId, int paint)
+{
+  if(connectivity[cellId] != 0 || !cellPasses(cellId))
+    return false;
+  connectivity[cellId] = paint;
+  regionSource->add(*regionSums, paint, cellId);
+  return true;
+}
+
+// A run of painted cells along i
+struct ConnectedThresholdSpan
+{
+  int j, k, first, last;
+};
+
+// Scanline fill: the cells are painted in runs along i. For each run taken off the
+// stack the four neighbouring rows (j-1, j+1, k-1, k+1) are scanned over the extent
+// of the run; every run found there is grown as far as it goes in both directions,
+// painted and pushed. The stack replaces the recursion that overflowed on large
+// connected regions.
+vtkIdType ConnectedThresholdWithCustomSourceFilter::executeConnectivity(int* connectivity, int i, int j, int k, int numb) {
+  const int nx = cellDimensions[0];
+  const int ny = cellDimensions[1];
+  const int nz = cellDimensions[2];
+  if(i<0 || j<0 ||k<0 || i>= nx || j>= ny || k>=nz)
+    return 0;
+
+  const vtkIdType sliceSize = (vtkIdType) nx * ny;
+  vtkIdType row = j * (vtkIdType) nx + k * sliceSize;
+  if(treeActive)
+    return paintTreeRegion(connectivity, (int) (row + i), numb);
+  if(!claimCell(connectivity, row + i, numb))
     return 0;
-  vtkIdType cellId = i+j*this->cellDimensions[0] + k*cellDimensions[0]*cellDimensions[1];
-  double val  = data->GetComponent(cellId,0);
-  double val2 = data2->GetComponent(cellId,0);
-
-	int result=0;
-  bool dataCheck  = ((Between(val) && !InsideOut) || (!Between(val) && InsideOut)) && (connectivity[cellId]==0);
-  bool data2Check = ((Between2(val2) && !InsideOut2) || (!Between2(val2) && InsideOut2)) && (connectivity[cellId]==0);
-  bool connected  = (Mode == 0) ? dataCheck && data2Check : (Mode == 1) ? dataCheck || data2Check : (Mode == 2) ? dataCheck : data2Check;
-  if(connected) {
-    connectivity[cellId]=numb;
-		result = 1;
-    result += executeConnectivity(data, data2, connectivity, i+1, j, k, numb);
-    result += executeConnectivity(data, data2, connectivity, i-1, j, k, numb);
-    result += executeConnectivity(data, data2, connectivity, i, j+1, k, numb);
-    result += executeConnectivity(data, data2, connectivity, i, j-1, k, numb);
-    result += executeConnectivity(data, data2, connectivity, i, j, k+1, numb);
-    result += executeConnectivity(data, data2, connectivity, i, j, k-1, numb);
+
+  ConnectedThresholdSpan span;
+  span.j = j;
+  span.k = k;
+  span.first = span.last = i;
+  while(span.first > 0 && claimCell(connectivity, row + span.first - 1, numb))
+    span.first--;
+  while(span.last < nx - 1 && claimCell(connectivity, row + span.last + 1, numb))
+    span.last++;
+  vtkIdType result = span.last - span.first + 1;
+
+  std::vector<ConnectedThresholdSpan> stack;
+  stack.push_back(span);
+  while(!stack.empty()) {
+    const ConnectedThresholdSpan current = stack.back();
+    stack.pop_back();
+
+    const int neighbourJ[4] = { current.j - 1, current.j + 1, current.j, current.j };
+    const int neighbourK[4] = { current.k, current.k, current.k - 1, current.k + 1 };
+    for(int n = 0; n < 4; n++) {
+      if(neighbourJ[n] < 0 || neighbourJ[n] >= ny || neighbourK[n] < 0 || neighbourK[n] >= nz)
+        continue;
+      row = neighbourJ[n] * (vtkIdType) nx + neighbourK[n] * sliceSize;
+
+      for(int x = current.first; x <= current.last; x++) {
+        if(!claimCell(connectivity, row + x, numb))
+          continue;
+        span.j = neighbourJ[n];
+        span.k = neighbourK[n];
+        span.first = span.last = x;
+        while(span.first > 0 && claimCell(connectivity, row + span.first - 1, numb))
+          span.first--;
+        while(span.last < nx - 1 && claimCell(connectivity, row + span.last + 1, numb))
+          span.last++;
+        result += span.last - span.first + 1;
+        stack.push_back(span);
+        x = span.last + 1; // evaluated and rejected (or the end of the row)
+      }
+    }
   }
   return result;
 }
@@ -26,6 +26,9 @@ PURPOSE.  See the above copyright notice for more information.
 
 class vtkPolyData;
 class vtkCellLocator;
+class vtkTable;
+struct ConnectedThresholdRegionSums; // see ConnectedThresholdRegionStatistics.h
+struct ConnectedThresholdRegionSource;
 
 class ConnectedThresholdWithCustomSourceFilter : public vtkDataSetAlgorithm
 {
@@ -73,6 +76,25 @@ public:
 // First, Second or both  (And/OR) setting
   vtkSetMacro(Mode, int);
 
+  // Description:
+  // Answer thresholds that only bound one side of the range of a single array
+  // (the other bound at or beyond the extreme value of the array) from a
+  // component tree of the array. The tree is built once per array and then
+  // gives the region of a seed without evaluating the rest of the grid, so
+  // dragging that threshold does not re-flood. It holds four ints per cell.
+  // On by default.
+  vtkSetMacro(UseComponentTree, int);
+  vtkGetMacro(UseComponentTree, int);
+  vtkBooleanMacro(UseComponentTree, int);
+
+  // Description:
+  // Cell arrays summed over each region in the statistics table (second
+  // output), which gets a _Sum and a _Mean column for each. The table also
+  // has the number of cells, the summed Cell_Volume (when the input has
+  // one), the ijk bounding box and the centroid of each label.
+  void AddStatisticsArray(const char* name);
+  void RemoveAllStatisticsArrays();
+
   //char* RVAArrayName;
   //vtkSetStringMacro(RVAArrayName);
   //vtkGetStringMacro(RVAArrayName);
@@ -88,10 +110,17 @@ protected:
   ConnectedThresholdWithCustomSourceFilter();
   virtual ~ConnectedThresholdWithCustomSourceFilter();
 
+  virtual int FillOutputPortInformation(int port, vtkInformation* info);
+  virtual int RequestDataObject(vtkInformation*,
+    vtkInformationVector**,
+    vtkInformationVector*);
+
 private:
   ConnectedThresholdWithCustomSourceFilter(const ConnectedThresholdWithCustomSourceFilter&);  // Not implemented.
   void operator=(const ConnectedThresholdWithCustomSourceFilter&);  // Not implemented.
 
+  friend class ConnectedThresholdFilter; // labels every region with its own iterateOverStartingPoints
+
   vtkStdString RVAArrayName;
   vtkStdString RVAArrayName2;
 
@@ -99,6 +128,7 @@ private:
   vtkStdString ResultArrayName;
 
   int Mode; // see executeConnectivity source for enumerated values
+  int UseComponentTree;
   int DataType;
 	vtkCellLocator* cellLocator;
 	int extent[6];
@@ -111,8 +141,67 @@ private:
   virtual void SetExtent(vtkDataSet* imageOrRectilinear, int extent[]);
   virtual int doThreshold(vtkInformation* outInfo, vtkDataSet* imageOrRectilinear, vtkDataSet* output, vtkPolyData* input2, vtkDataArray* inScalars, vtkDataArray* inScalars2);
 
-  // recursive method
-  vtkIdType executeConnectivity(vtkDataArray* data, vtkDataArray* data2, int* connectivity, int i, int j, int k, int paint);
+  // paints the cells connected to (i,j,k) that pass the threshold, returns their number
+  vtkIdType executeConnectivity(int* connectivity, int i, int j, int k, int paint);
+  bool claimCell(int* connectivity, vtkIdType cellId, int paint);
+
+  // Evaluates the threshold (both ranges, InsideOut and Mode) of every cell in one pass
+  // over the arrays. The result is kept until the arrays or the settings change, so
+  // moving the seed points does not evaluate it again.
+  bool updatePassMask(vtkDataArray* data, vtkDataArray* data2);
+  bool cellPasses(vtkIdType cellId) const { return ((passMask[cellId >> 5] >> (cellId & 31)) & 1) != 0; }
+
+  //BTX
+  // What passMask was computed from
+  struct PassMaskKey
+  {
+    vtkDataArray* arrays[2];
+    unsigned long arrayTimes[2];
+    double thresholds[4];
+    bool insideOut[2];
+    int mode;
+    vtkIdType cells;
+  };
+  std::vector<unsigned int> passMask; // bit c%32 of word c/32 is set if cell c passes
+  PassMaskKey passMaskKey;
+  //ETX
+
+  // Selects (and builds if needed) the component tree for this execution, false if
+  // the thresholds are not one sided and the seeds are flooded with passMask.
+  bool updateComponentTree(vtkDataArray* data, vtkDataArray* data2);
+  vtkIdType paintTreeRegion(int* connectivity, int seed, int paint);
+
+  //BTX
+  // Component tree of 6-connected cells. The cells are added in order of value,
+  // highest first for a max-tree (regions above a threshold), lowest first for a
+  // min-tree (regions below). A node starts where a region appears or where a cell
+  // joins several regions (its children), and owns the cells that then extend it.
+  // The cells are laid out in post-order, so the region of a seed at a threshold is
+  // the slice of layout from the start of its highest node that passes to the last
+  // own cell of that node that passes.
+  struct ComponentTree
+  {
+    vtkDataArray* array;
+    unsigned long arrayTime;
+    std::vector<int> order;     // cells of the array in increasing value, NaN left out
+    int direction;              // 1 max-tree, -1 min-tree, 0 not built
+    std::vector<int> node;      // node of each cell, -1 for NaN
+    std::vector<int> layout;    // cells of each subtree, then the own cells of its node in the order they were added
+    std::vector<int> parent;    // parent of each node, -1 for roots
+    std::vector<int> first;     // layout index of the first cell of the subtree of each node
+    std::vector<int> own;       // layout index of its first own cell, the one that started the node
+    std::vector<int> end;       // layout index past the subtree
+  };
+  ComponentTree componentTree;
+  bool treeActive; // the seeds of this execution are answered from componentTree
+
+  std::vector<vtkStdString> StatisticsArrays;
+  ConnectedThresholdRegionSource* regionSource;
+  ConnectedThresholdRegionSums* regionSums; // of the labels painted in this execution
+  //ETX
+
+  void prepareRegionStatistics(vtkDataSet* input);
+  void fillStatisticsTable(vtkTable* table);
 
   int WholeExtent[6];
   int cellDimensions[3];
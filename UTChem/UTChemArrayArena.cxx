@@ -0,0 +1,125 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemArrayArena
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "UTChemArrayArena.h"
+
+#include "vtkFloatArray.h"
+
+// Chunks hold at least one step and otherwise about 64 MB
+static const size_t chunkBytes = 64 * 1024 * 1024;
+
+UTChemArrayArena::UTChemArrayArena(vtkIdType valuesPerSlot)
+  : valuesPerSlot(valuesPerSlot > 0 ? valuesPerSlot : 1)
+{
+  size_t slotBytes = (size_t) this->valuesPerSlot * sizeof(float);
+  slotsPerChunk = (int) (chunkBytes / slotBytes);
+  if (slotsPerChunk < 1) {
+    slotsPerChunk = 1;
+  }
+  if (slotsPerChunk > 64) {
+    slotsPerChunk = 64;
+  }
+}
+
+UTChemArrayArena::~UTChemArrayArena()
+{
+  for (size_t i = 0; i < slots.size(); ++i) {
+    vtkFloatArray* array = slots[i].array;
+    if (array->GetReferenceCount() > 1) {
+      // Still shown somewhere: move the values out of the chunk into memory
+      // the array allocates (and frees) itself
+      vtkFloatArray* copy = vtkFloatArray::New();
+      copy->DeepCopy(array);
+      array->DeepCopy(copy);
+      copy->Delete();
+    }
+    array->Delete();
+  }
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    delete [] chunks[i];
+  }
+}
+
+void UTChemArrayArena::addChunk()
+{
+  float* chunk = new float[(size_t) valuesPerSlot * slotsPerChunk];
+  chunks.push_back(chunk);
+  for (int i = 0; i < slotsPerChunk; ++i) {
+    Slot slot;
+    slot.array = vtkFloatArray::New();
+    slot.array->SetArray(chunk + (size_t) valuesPerSlot * i, valuesPerSlot, 1);
+    slot.inUse = false;
+    slots.push_back(slot);
+  }
+}
+
+// A reference count of 1 means only the arena holds the array; the pipeline thread
+// is the only one that changes it, so the test cannot race with a new reference
+vtkFloatArray* UTChemArrayArena::acquire()
+{
+  size_t i = 0;
+  for (; i < slots.size(); ++i) {
+    if (!slots[i].inUse && slots[i].array->GetReferenceCount() == 1) {
+      break;
+    }
+  }
+  if (i == slots.size()) {
+    addChunk();
+  }
+  slots[i].inUse = true;
+  slots[i].array->Register(NULL);
+  slots[i].array->Modified(); // new values, cached ranges are stale
+  return slots[i].array;
+}
+
+bool UTChemArrayArena::release(vtkFloatArray* array)
+{
+  for (size_t i = 0; i < slots.size(); ++i) {
+    if (slots[i].array == array) {
+      slots[i].inUse = false;
+      array->UnRegister(NULL);
+      freeIdleChunks();
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t UTChemArrayArena::getAllocatedBytes() const
+{
+  return chunks.size() * (size_t) valuesPerSlot * slotsPerChunk * sizeof(float);
+}
+
+void UTChemArrayArena::freeIdleChunks()
+{
+  for (size_t c = chunks.size(); c-- > 0; ) {
+    const size_t first = c * slotsPerChunk, last = first + slotsPerChunk;
+    bool idle = true;
+    for (size_t i = first; i < last && idle; ++i) {
+      idle = !slots[i].inUse && slots[i].array->GetReferenceCount() == 1;
+    }
+    if (!idle) {
+      continue;
+    }
+    for (size_t i = first; i < last; ++i) {
+      slots[i].array->Delete();
+    }
+    slots.erase(slots.begin() + first, slots.begin() + last);
+    delete [] chunks[c];
+    chunks.erase(chunks.begin() + c);
+  }
+}
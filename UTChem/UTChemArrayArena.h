@@ -0,0 +1,69 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemArrayArena
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __UTChemArrayArena_h
+#define __UTChemArrayArena_h
+
+#include <cstddef>
+#include <vector>
+
+#include "vtkType.h"
+
+class vtkFloatArray;
+
+// Storage for the decoded time steps of one variable.
+// Steps live next to each other in large chunks ([step][cell]) and are
+// handed out as vtkFloatArrays pointing into a chunk (SetArray with
+// save=1), so decoding a step does not allocate once the chunks exist.
+// A released slot is only reused after VTK dropped every other reference
+// to its array, so outputs never see their values change. A chunk is freed
+// as soon as all of its slots are idle in that sense.
+//
+// Only for the thread that runs the pipeline: the reference counts tested
+// here are changed by the pipeline without any lock, so another thread
+// could hand out a slot that is still being shown.
+class UTChemArrayArena
+{
+public:
+  UTChemArrayArena(vtkIdType valuesPerSlot);
+  ~UTChemArrayArena(); // arrays still referenced elsewhere get a private copy
+
+  vtkFloatArray* acquire(); // new reference, values are not initialized
+  bool release(vtkFloatArray* array); // false if array does not belong to this arena
+
+  size_t getAllocatedBytes() const;
+  void freeIdleChunks(); // also done by release, this catches arrays VTK dropped later
+
+private:
+  UTChemArrayArena(const UTChemArrayArena&); // Not implemented.
+  void operator=(const UTChemArrayArena&); // Not implemented.
+
+  void addChunk();
+
+  struct Slot
+  {
+    vtkFloatArray* array; // wraps the slot's values, owned by the arena
+    bool inUse;
+  };
+
+  vtkIdType valuesPerSlot;
+  int slotsPerChunk;
+  std::vector<float*> chunks;
+  std::vector<Slot> slots;
+};
+
+#endif /* __UTChemArrayArena_h */
@@ -21,11 +21,13 @@ PURPOSE.  See the above copyright notice for more information.
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <cstring>
 #include <cassert>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <cctype>
+#include <algorithm>
 
 #include "vtkInformationVector.h"
 #include "vtkInformation.h"
@@ -41,15 +43,25 @@ PURPOSE.  See the above copyright notice for more information.
 #include "vtkImageData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkRectilinearGrid.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h"
 
 #include <RVA_Util.h>
+#include "UTChemScanner.h"
 
 UTChemAsciiReader::UTChemAsciiReader() :
-  dataObj(NULL), FileName(0) 
+  FileName(0), CacheDecodedArrays(0), StepCacheSize(1024), PrefetchSteps(2), FollowFile(0),
+  stepCacheHits(0), stepCacheMisses(0), prefetchThreadId(-1), prefetchRunning(false),
+  servedStep(0), lastRequestedStep(-1), playDirection(1), backgroundDecode(false), deferMessages(false),
+  observedSize(-1), observedMTime(-1), indexedBytes(0), followOffset(0), unfinishedStep(-1),
+  cursor(NULL), reachedEnd(false), dataObj(NULL), Sidecar(NULL), sidecarReadOnly(false),
+  deferBlocks(false), listArraysOnly(false), skippedBlocks(false)
 {
    *this->phaseName = '\0';
 
-  this->InputInfo = new UTChemInputReader("");
+  this->InputInfo = UTChemInputReader::acquire("");
+  this->PrefetchThreader = vtkMultiThreader::New();
+  this->DecodeLock = vtkMutexLock::New();
   this->SetDebug(1);
   this->SetNumberOfInputPorts(0);
   this->SetNumberOfOutputPorts(1);
@@ -57,10 +69,15 @@ UTChemAsciiReader::UTChemAsciiReader() :
 
 UTChemAsciiReader::~UTChemAsciiReader() 
 {
+  stopPrefetch();
   freeDataVectors();
   SetFileName(0);
-  delete this->InputInfo;
+  UTChemInputReader::release(this->InputInfo);
   this->InputInfo=NULL;
+  delete this->Sidecar;
+  this->Sidecar=NULL;
+  this->PrefetchThreader->Delete();
+  this->DecodeLock->Delete();
   if (dataObj) 
   {
     dataObj->Delete();
@@ -113,8 +130,11 @@ int UTChemAsciiReader::RequestDataObject(vtkInformation* req,
     dataObj->Delete();
   }
 
-  dataObj = InputInfo->getObject(info); // also does SetPipelineInformation
-  dataObj->Register(this);
+  dataObj = InputInfo->getObject(info); // new instance, also does SetPipelineInformation
+  if (!dataObj) 
+  {
+    return 0;
+  }
   int extType = dataObj->GetExtentType();
   vtkInformation * algInfo = this->GetOutputPortInformation(0);
   algInfo->Set(vtkDataObject::DATA_EXTENT_TYPE(), extType);
@@ -131,20 +151,37 @@ int UTChemAsciiReader::RequestInformation(vtkInformation *vtkNotUsed(request),
     return 0;
   }
   
-  if (timeList.size() > 0) 
+  if (timeList.size() > 0 && FollowFile) 
   {
-    vtkErrorMacro(<<"Trying to reading file more than once!");
+    unsigned first = 0;
+    if (!updateTimeStepIndex(first)) 
+    {
+      vtkErrorMacro("File parsing failed");
+      return 0;
+    }
+    if (first < stepIndex.size()) 
+    {
+      collectArrayNames(first); // only the steps that were (re)indexed
+    }
   }
-  else 
+  else if (timeList.empty()) 
   {
-    int success = readFile(); // 0 if failed, 1 if successful
+    // Only the TIME/layer offsets are collected here, values are decoded on demand in RequestData
+    int success = buildTimeStepIndex(); // 0 if failed, 1 if successful
   
     if (!success) 
     {
 	  vtkErrorMacro("File parsing failed");
 	  return 0; // Fail
     }
+    if (!listSidecarArrays()) 
+    {
+      collectArrayNames();
+      writeSidecarIndex(); // after collectArrayNames, so that the names are stored with the index
+    }
   }
+  // Otherwise the index is still valid: only a property such as StepCacheSize or an
+  // array selection changed, and the cached time steps are simply reported again
   
   vtkInformation * outInfo  = outVec->GetInformationObject(0);
 
@@ -179,7 +216,6 @@ int UTChemAsciiReader::RequestData(vtkInformation *vtkNotUsed(request),
   vtkInformation * outInfo  = outVec->GetInformationObject(0);
   double* requestedTimeSteps = NULL;
   unsigned bestidx = 0;
-  currentTimeStep = NULL;
 
   if (outInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS())) 
   {
@@ -202,15 +238,78 @@ int UTChemAsciiReader::RequestData(vtkInformation *vtkNotUsed(request),
   assert(timeList.size() == allData.size());
   assert(InputInfo);
 
-  return buildVTKObject(bestidx, outInfo);
+  // Steps prefetched for the other direction are of no use any more
+  int direction = playDirection;
+  if (lastRequestedStep >= 0 && (int) bestidx != lastRequestedStep) 
+  {
+    direction = (int) bestidx > lastRequestedStep ? 1 : -1;
+  }
+  if (direction != playDirection) 
+  {
+    stopPrefetch();
+  }
+  playDirection = direction;
+  lastRequestedStep = bestidx;
+
+  DecodeLock->Lock(); // waits for a step the prefetch thread is decoding
+  servedStep = bestidx;
+  if (allData[bestidx]) 
+  {
+    stepCacheHits++;
+  }
+  else 
+  {
+    stepCacheMisses++;
+    if (!readTimeStep(bestidx)) 
+    {
+      DecodeLock->Unlock();
+      vtkErrorMacro(<< "Failed to read time step index " << bestidx)
+      return 0;
+    }
+  }
+  touchTimeStep(bestidx);
+  trimStepCache(bestidx);
+
+  vtkDebugMacro(<< "Step cache: " << stepCacheHits << " hits, " << stepCacheMisses << " misses, "
+                << stepUsage.size() << " steps resident")
+  DecodeLock->Unlock();
+  reportDeferredMessages();
+
+  int ret = buildVTKObject(bestidx, outInfo);
+  startPrefetch(bestidx);
+  return ret;
 }
 
 void UTChemAsciiReader::PrintSelf(ostream& os, vtkIndent indent)
 {
   os << indent << "File name: "<< (FileName ? FileName : "(none)") << "\n";
+  os << indent << "CacheDecodedArrays: "<< CacheDecodedArrays << "\n";
+  os << indent << "StepCacheSize: "<< StepCacheSize << " MB\n";
+  os << indent << "PrefetchSteps: "<< PrefetchSteps << "\n";
+  os << indent << "FollowFile: "<< FollowFile << "\n";
   Superclass::PrintSelf(os, indent);
 }
 
+unsigned long UTChemAsciiReader::GetMTime()
+{
+  unsigned long mtime = this->Superclass::GetMTime();
+  if (FollowFile && FileName) 
+  {
+    long long size = 0, fileMTime = 0;
+    if (UTChemMappedFile::stat(FileName, size, fileMTime) && (size != observedSize || fileMTime != observedMTime)) 
+    {
+      observedSize = size;
+      observedMTime = fileMTime;
+      FileChangeTime.Modified();
+    }
+    if (FileChangeTime.GetMTime() > mtime) 
+    {
+      mtime = FileChangeTime.GetMTime();
+    }
+  }
+  return mtime;
+}
+
 std::string UTChemAsciiReader::getInputFileFromFileName(const char* filename)
 {
   std::string tmp(filename);
@@ -272,12 +371,17 @@ static std::string sanitizeName(std::string name)
 // Sets floatarray's name using instance vars componentNames and phaseName
 void UTChemAsciiReader::setMeaningfulArrayName(vtkFloatArray* array,
         int thePhase, std::string arrName, bool absolutePhase)
+{
+  array->SetName(getMeaningfulArrayName(thePhase, arrName, absolutePhase).c_str());
+}
+
+// Builds an array name from componentNames and phaseName (and resets phaseName)
+std::string UTChemAsciiReader::getMeaningfulArrayName(int thePhase,
+        std::string arrName, bool absolutePhase)
 {
   if (!arrName.empty()) 
   {
-    std::string niceName = sanitizeName(arrName);
-    array->SetName(niceName.c_str());
-    return;
+    return sanitizeName(arrName);
   }
 
   std::ostringstream name;
@@ -330,12 +434,12 @@ void UTChemAsciiReader::setMeaningfulArrayName(vtkFloatArray* array,
     name<< "_"<< phaseName;
     *phaseName = '\0';
   }
-  std::string niceName(sanitizeName(name.str().c_str()));
-  array->SetName(niceName.c_str());
+  return sanitizeName(name.str().c_str());
 }
 
 void UTChemAsciiReader::freeDataVectors()
 {
+  stopPrefetch();
   currentTimeStep = NULL;
   componentNames.clear();
   timeList.clear();
@@ -356,7 +460,7 @@ void UTChemAsciiReader::freeDataVectors()
       //assert(array);
       if (array) 
       {
-        array->Delete();
+        releaseArray((*it).first, array);
       }
     }
     scalars->clear();
@@ -364,6 +468,13 @@ void UTChemAsciiReader::freeDataVectors()
     scalars = NULL;
   }
   allData.clear();
+  for (std::map<int, UTChemArrayArena*>::iterator it = arenas.begin(); it != arenas.end(); it++) 
+  {
+    delete (*it).second; // arrays still shown get their own copy
+  }
+  arenas.clear();
+  stepIndex.clear();
+  stepUsage.clear();
   nx=-1,ny=-1,nz=-1;
   fileLength = 0;
   line_num = 0;
@@ -374,10 +485,12 @@ void UTChemAsciiReader::freeDataVectors()
 
 // MVM: why are we reloading? Just because the ctor makes a 
 // InputInfo object without a file?
+// Cheap unless INPUT changed: parsed decks are shared through UTChemInputReader::acquire
 void UTChemAsciiReader::reloadInputFile(const char*filename) {
   std::string inputfile(getInputFileFromFileName(filename));
-  delete this->InputInfo;
-  this->InputInfo = new UTChemInputReader(inputfile); 
+  UTChemInputReader* info = UTChemInputReader::acquire(inputfile);
+  UTChemInputReader::release(this->InputInfo);
+  this->InputInfo = info;
 }
 
 // MVM: ... why is this handling time and not using a Temporal Filter?
@@ -412,16 +525,17 @@ int UTChemAsciiReader::buildVTKObject(const unsigned& bestidx, vtkInformation* o
 
   vtkDataSet * dataSet = vtkDataSet::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
 
-  currentTimeStep = allData[bestidx];
-  assert(currentTimeStep);
+  // Not currentTimeStep, the prefetch thread may be decoding into that one
+  IntegerTovtkFloatArrayMap* step = allData[bestidx];
+  assert(step);
   
-  if (!currentTimeStep) 
+  if (!step) 
   {
     vtkErrorMacro(<<"No data arrays are not unset for time step index "<<bestidx)
     return 0;
   }
  
-  if (currentTimeStep->size() == 0) 
+  if (step->size() == 0) 
   {
     vtkErrorMacro(<<"Strange... This timestep has no data arrays. time index="<<bestidx)
   }
@@ -445,7 +559,13 @@ int UTChemAsciiReader::buildVTKObject(const unsigned& bestidx, vtkInformation* o
   if (ret)
   {
     dataSet->GetInformation()->Set(vtkDataObject::DATA_TIME_STEPS(), &timeList[bestidx], 1);
-    IntegerTovtkFloatArrayMap_it it = currentTimeStep->begin(), end = currentTimeStep->end();
+    // Static properties of the deck are shared, not copied. Arrays of the file come
+    // last so that they replace properties of the same name.
+    for (size_t i = 0; i < InputInfo->cellProperties.size(); i++) 
+    {
+      dataSet->GetCellData()->AddArray(InputInfo->cellProperties[i]);
+    }
+    IntegerTovtkFloatArrayMap_it it = step->begin(), end = step->end();
     for (; it != end; it++) 
     {
       vtkFloatArray* array = (*it).second;
@@ -533,32 +653,50 @@ int UTChemAsciiReader::buildSGridData(vtkDataSet * dataSet)
 
 void UTChemAsciiReader::readNXNYnumericalValuesIntoArray(float*output)
 {
-  int i = 0;
-  int expected = nx * ny;
- 
-  std::stringstream ss;
-  std::string str;
+  // Numbers are scanned straight out of the mapped file, see UTChemScanner.h.
+  // Note that gfortran seems to output "NaN", unknown what other
+  // compilers used for UTChem might output. Anything that is not a
+  // number is stored as NaN.
+  if (deferBlocks) 
+  {
+    // decodeTimeStepBlocks will scan the numbers on a worker thread
+    UTChemPendingBlock block;
+    block.begin = cursor;
+    block.end = mappedFile.end();
+    block.output = output;
+    block.notNumbers = 0;
+    block.failed = false;
+    pendingBlocks.push_back(block);
+    return;
+  }
 
-  while (i < expected) 
+  int notNumbers = 0;
+  const char* next = scanFloats(cursor, mappedFile.end(), output, nx * ny, notNumbers);
+  if (!next) 
   {
-  // MVM: reading input file stream into string instead of directly
-  // into float because ASCII "NaN" was causing an infinite loop, 
-  // not entirely sure how.
-  // Note that gfortran seems to output "NaN", unknown what other
-  // compilers used for UTChem might output.
-  stream >> str;
-  ss.str(str);
+    throw std::runtime_error("Unexpected end of file while reading values");
+  }
+  cursor = next;
 
-  if (str != "NaN") {
-    ss >> output[i];
+  if (notNumbers) 
+  {
+    vtkDecodeErrorMacro(<<"Note: input file contains NaNs");
   }
-  else {
-    vtkErrorMacro(<<"Note: input file contains NaNs");
-    output[i] = std::numeric_limits<float>::quiet_NaN();
+}
+
+// Moves past the values of a block that is not going to be stored
+void UTChemAsciiReader::skipNXNYnumericalValues()
+{
+  if (deferBlocks) 
+  {
+    return; // decodeTimeStepBlocks knows where the next block starts
   }
-  ss.clear();
-  i++;
+  const char* next = scanSkipValues(cursor, mappedFile.end(), nx * ny);
+  if (!next) 
+  {
+    throw std::runtime_error("Unexpected end of file while reading values");
   }
+  cursor = next;
 }
 
 // Uses current phase and layer state to find correct float array
@@ -567,6 +705,24 @@ int UTChemAsciiReader::readLayerValues(std::string name, bool absolutePhase)
 {
   unsigned arraySize = nx*ny*nz;
 
+  if (listArraysOnly) 
+  {
+    listedArrayName = getMeaningfulArrayName(phase, name, absolutePhase);
+    size_t i = 0;
+    while (i < listedArrays.size() && listedArrays[i].name != listedArrayName) 
+    {
+      i++;
+    }
+    if (i == listedArrays.size()) 
+    {
+      UTChemSidecar::ArrayLayers array = { listedArrayName, 0 };
+      listedArrays.push_back(array);
+    }
+    listedArrays[i].layers = std::max(listedArrays[i].layers, layer);
+    addArrayName(listedArrayName);
+    return 1;
+  }
+
   if (currentTimeStep == NULL || arraySize==0)
   {
     throw std::runtime_error("Can't readLayerValues when there's no current time step (or proper dimensions)");
@@ -579,11 +735,17 @@ int UTChemAsciiReader::readLayerValues(std::string name, bool absolutePhase)
   
   if (!currentTimeStep->count(phase)) 
   {
-    vtkFloatArray* floatArray = vtkFloatArray::New();
-    floatArray->SetNumberOfValues(arraySize);
-    floatArray->FillComponent(0,std::numeric_limits<float>::quiet_NaN() );
-    setMeaningfulArrayName(floatArray, phase, name, absolutePhase );
+    std::string arrayName = getMeaningfulArrayName(phase, name, absolutePhase);
+    if (!isArrayEnabled(arrayName.c_str())) 
+    {
+      skippedBlocks = true;
+      skipNXNYnumericalValues();
+      return 1;
+    }
+    vtkFloatArray* floatArray = acquireArray(phase);
+    floatArray->SetName(arrayName.c_str());
     (*currentTimeStep)[phase]=floatArray;
+    layersRead[phase].assign(nz, false); // see fillUnreadLayers
   }
   oneGrid = (*currentTimeStep)[phase]->GetPointer(0);
   assert(oneGrid);
@@ -593,6 +755,10 @@ int UTChemAsciiReader::readLayerValues(std::string name, bool absolutePhase)
   {
     throw std::runtime_error("Unexpected layer value");
   }
+  if (layersRead.count(phase)) 
+  {
+    layersRead[phase][layer-1] = true;
+  }
   
   float* ptr = oneGrid+(nx*ny*(layer-1));
 
@@ -602,51 +768,71 @@ int UTChemAsciiReader::readLayerValues(std::string name, bool absolutePhase)
 }
 
 
-// Returns either: 0=Bad file (and no stream is open) or
-// 1=Good stream (and file extension and length of file is known)
+// Returns either: 0=Bad file (and nothing is mapped) or
+// 1=Good file mapped at cursor (and file extension and length of file is known)
 int UTChemAsciiReader::initializeStream()
 {
   this->file_ext = getFileExtension(FileName);
   if (file_ext.empty()) 
   {
-    vtkErrorMacro(<<"File extension not found:"<<FileName)
+    vtkDecodeErrorMacro(<<"File extension not found:"<<FileName)
     return 0;
   }
-  try {
-    stream.exceptions( std::ifstream::badbit | std::ifstream::failbit);
-    stream.open(FileName); // may set failbit
-
-    stream.seekg (0, ios::end);
-    fileLength  = (double) stream.tellg(); // approximate
-    if (fileLength < 1)
-    { 
-      fileLength = 1;// paranoia as we divide by fileLength later
-    }
-    stream.seekg (0, ios::beg);
-
-    stream.exceptions( std::ifstream::badbit );
-    // getline may set std::ifstream::failbit if last line is blank-
-    //"the function extracts no characters, it calls is.setstate(ios_base::failbit) which may throw ios_base::failure (27.5.5.4)."
-
-  } catch(const std::exception& e) {
-    vtkErrorMacro(<<"Could not open the file. Exception:"<<e.what());
-    try {
-      stream.close();
-    } catch (...) {}
+  // A followed file may be truncated by the simulation at any time, so it is not mapped
+  if (!mappedFile.open(FileName, FollowFile != 0)) 
+  {
+    vtkDecodeErrorMacro(<<"Could not open the file "<<FileName);
     return 0; // Failed
   }
+  cursor = mappedFile.begin();
+  reachedEnd = false;
+  fileLength = (double) mappedFile.size();
+  if (fileLength < 1)
+  { 
+    fileLength = 1;// paranoia as we divide by fileLength later
+  }
   return 1; // Success
 }
 
+void UTChemAsciiReader::closeStream()
+{
+  mappedFile.close();
+  cursor = NULL;
+}
+
+// Copies the line at cursor into nextLine (without the line ending) and moves to the next line.
+// Sets reachedEnd instead if there is nothing left to read.
 const char* UTChemAsciiReader::readNextLine(bool mustBeNonEmpty) {
-  std::getline(stream, nextLine);
-  if (mustBeNonEmpty && 0 == nextLine.length()) 
+  const char* lineEnd;
+  const char* line = readNextRawLine(lineEnd, mustBeNonEmpty);
+  nextLine.assign(line, lineEnd);
+  return nextLine.c_str();
+}
+
+const char* UTChemAsciiReader::readNextRawLine(const char*& lineEnd, bool mustBeNonEmpty) {
+  const char* end = mappedFile.end();
+  const char* line = cursor;
+  if (!cursor || cursor >= end) 
+  {
+    reachedEnd = true;
+    line = lineEnd = "";
+  }
+  else 
+  {
+    const char* eol = (const char*) memchr(cursor, '\n', end - cursor);
+    lineEnd = eol ? eol : end;
+    if (lineEnd > cursor && lineEnd[-1] == '\r') 
     {
-    throw std::runtime_error("Expected to read non-blank line from file");
+      lineEnd--; // DOS line endings
     }
-    const char* c_str= nextLine.c_str();
-    line_num++;
-    return c_str;
+    cursor = eol ? eol + 1 : end;
+  }
+  if (mustBeNonEmpty && line == lineEnd) 
+  {
+    throw std::runtime_error("Expected to read non-blank line from file");
+  }
+  line_num++;
+  return line;
 }
 
 // Reads a UTChem data file (.CONC / .VISC etc )
@@ -672,48 +858,20 @@ int UTChemAsciiReader::readFile()
   
     readHeader(); // gets valid nx,ny,nz or throws exception. Subclasses should also reset their state here
 
-    while (true) 
-    {
-      const char* c_str= readNextLine(false);
-
-      if (stream.eof()) 
-      {
-        break;
-      }
-
-      while (*c_str == ' ') 
-      {
-        c_str++; // skip leading spaces
-      }
-
-      if (!*c_str) 
-      {// empty line. Rinse and Repeat
-        continue;
-      }
-
-      int parsed = parseLine(c_str);
-
-      if (!parsed) 
-      {
-        vtkErrorMacro(<<"Could not parse line #"<<line_num<<":'"<<nextLine<<"'");
-        throw std::runtime_error("Parse failed");
-      }
-    }// while
+    parseRemainingLines();
   } catch (const std::exception& e) {
     failed = true;
-    vtkErrorMacro(<<"Exception :" <<e.what());
+    vtkDecodeErrorMacro(<<"Exception :" <<e.what());
   }
   
-  try {
-    stream.close();
-  } catch (...) {}
+  closeStream();
 
   currentTimeStep = NULL;
-  vtkDebugMacro(<<"Lines read:"<<line_num);
+  vtkDecodeDebugMacro(<<"Lines read:"<<line_num);
   
   if (!failed) 
   {
-    vtkDebugMacro(<<"File reading completed without error.")
+    vtkDecodeDebugMacro(<<"File reading completed without error.")
   } 
   else 
   {
@@ -722,12 +880,1204 @@ int UTChemAsciiReader::readFile()
  
   this->UpdateProgress(1.0);
 
-  vtkDebugMacro(<<" nx*ny*nz="<<(nx*ny*nz)<<" timeList size = "<<timeList.size()<<" data size = "<<allData.size() )
+  vtkDecodeDebugMacro(<<" nx*ny*nz="<<(nx*ny*nz)<<" timeList size = "<<timeList.size()<<" data size = "<<allData.size() )
 
   return !failed && validFileRead(); // to be valid we did not choke and read at least one time step
 }
 
+void UTChemAsciiReader::parseRemainingLines()
+{
+  const char* begin = mappedFile.begin();
+  while (true) 
+  {
+    const char* lineStart = cursor;
+    const char* c_str= readNextLine(false);
+
+    if (reachedEnd) 
+    {
+      break;
+    }
+
+    if (FollowFile && cursor == mappedFile.end() && cursor[-1] != '\n') 
+    {
+      // The writer is still busy with this line, read it next time
+      cursor = lineStart;
+      break;
+    }
+
+    while (*c_str == ' ') 
+    {
+      c_str++; // skip leading spaces
+    }
+
+    if (!*c_str) 
+    {// empty line. Rinse and Repeat
+      continue;
+    }
+
+    int parsed = parseLine(c_str);
+
+    if (!parsed) 
+    {
+      vtkDecodeErrorMacro(<<"Could not parse line #"<<line_num<<":'"<<nextLine<<"'");
+      throw std::runtime_error("Parse failed");
+    }
+  }// while
+  followOffset = cursor - begin;
+}
+
+// Follow mode: parses the lines appended since readFile (or the previous call) stopped
+int UTChemAsciiReader::readAppendedLines()
+{
+  if (!FileName || !initializeStream()) 
+  {
+    return 0;
+  }
+  if (followOffset > (std::streamoff) mappedFile.size()) 
+  {
+    closeStream();
+    return readFile(); // the file was rewritten
+  }
+
+  bool failed = false;
+  try {
+    cursor = mappedFile.begin() + followOffset;
+    parseRemainingLines();
+  } catch (const std::exception& e) {
+    failed = true;
+    vtkDecodeErrorMacro(<<"Exception :" <<e.what());
+  }
+  closeStream();
+
+  return !failed && validFileRead();
+}
+
 bool UTChemAsciiReader::validFileRead()
 {
   return timeList.size() > 0;
 }
+
+// Default: no time markers, the whole file is a single (timeless) step
+int UTChemAsciiReader::isTimeStepLine(const char* c_str, double& t)
+{
+  return 0;
+}
+
+int UTChemAsciiReader::isBlockHeaderLine(const char* c_str)
+{
+  return contains(c_str, "IN LAYER");
+}
+
+// Fast pass over the file that only records where each time step and layer block starts.
+// Numerical lines are skipped without conversion; see readTimeStep for the actual decoding.
+int UTChemAsciiReader::buildTimeStepIndex()
+{
+  if (!FileName) 
+  {
+    return 0;
+  }
+
+  freeDataVectors();
+
+  if (loadSidecarIndex()) 
+  {
+    long long size = 0, mtime = 0;
+    indexedBytes = UTChemMappedFile::stat(FileName, size, mtime) ? size : 0;
+    return validFileRead(); // no need to look at the file itself
+  }
+
+  this->SetProgressText(FileName);
+
+  if (!initializeStream()) 
+  {
+    return 0;
+  }
+
+  bool failed = false;
+
+  try {
+    readHeader(); // gets valid nx,ny,nz or throws exception
+    scanTimeSteps();
+    dropIncompleteLastStep();
+  } catch (const std::exception& e) {
+    failed = true;
+    vtkErrorMacro(<<"Exception :" <<e.what());
+  }
+
+  indexedBytes = mappedFile.size();
+  closeStream();
+
+  if (failed) 
+  {
+    freeDataVectors();
+    return 0;
+  }
+
+  for (unsigned i = 0; i < stepIndex.size(); ++i) 
+  {
+    timeList.push_back(stepIndex[i].time);
+  }
+  allData.resize(stepIndex.size(), NULL);
+
+  this->UpdateProgress(1.0);
+
+  vtkDebugMacro(<<" nx*ny*nz="<<(nx*ny*nz)<<" indexed time steps = "<<stepIndex.size())
+
+  return validFileRead();
+}
+
+// Records the offsets of the time steps and blocks between cursor and the end of the mapping.
+// Numerical lines are skipped without conversion.
+void UTChemAsciiReader::scanTimeSteps()
+{
+  const char* begin = mappedFile.begin();
+  const char* end = mappedFile.end();
+  unfinishedStep = -1;
+
+  while (cursor < end) 
+  {
+    const char* lineStart = cursor;
+    const char* eol = (const char*) memchr(cursor, '\n', end - cursor);
+    const char* lineEnd = eol ? eol : end;
+    cursor = eol ? eol + 1 : end;
+    line_num++;
+
+    const char* c_str = lineStart;
+    while (c_str < lineEnd && *c_str == ' ') 
+    {
+      c_str++;
+    }
+
+    // Empty or numerical lines make up almost the whole file
+    if (c_str == lineEnd || *c_str == '\r' || isdigit(*c_str) || *c_str == '-' || *c_str == '+' || *c_str == '.')
+    {
+      continue;
+    }
+
+    nextLine.assign(c_str, lineEnd);
+    if (!nextLine.empty() && *(nextLine.end()-1) == '\r') 
+    {
+      nextLine.erase(nextLine.length()-1);
+    }
+
+    indexLine(nextLine.c_str(), lineStart - begin);
+
+    if ((line_num & 0xFFFF) == 0) 
+    {
+      this->UpdateProgress((cursor - begin) / fileLength);
+    }
+  }
+}
+
+// Called by scanTimeSteps for every line that is not numerical
+void UTChemAsciiReader::indexLine(const char* c_str, std::streamoff offset)
+{
+  double t = 0;
+  if (isTimeStepLine(c_str, t)) 
+  {
+    TimeStepEntry entry;
+    entry.time = t;
+    entry.offset = offset;
+    stepIndex.push_back(entry);
+  }
+  else if (isBlockHeaderLine(c_str)) 
+  {
+    if (stepIndex.empty()) 
+    {
+      // Timeless data (e.g. PERM) - treat as a single step at time 0
+      TimeStepEntry entry;
+      entry.time = 0.0;
+      entry.offset = offset;
+      stepIndex.push_back(entry);
+    }
+    stepIndex.back().blocks.push_back(offset);
+  }
+}
+
+// In follow mode the last step is only indexed once all of its blocks have been written
+void UTChemAsciiReader::dropIncompleteLastStep()
+{
+  if (!FollowFile || stepIndex.size() < 2) 
+  {
+    return;
+  }
+  const TimeStepEntry& last = stepIndex.back();
+  bool complete = !last.blocks.empty() && last.blocks.size() >= stepIndex[0].blocks.size();
+  if (complete) 
+  {
+    // the values of the last block must be followed by something, else the last number may be cut short
+    cursor = mappedFile.begin() + last.blocks.back();
+    readNextLine(false);
+    const char* p = reachedEnd ? NULL : scanSkipValues(cursor, mappedFile.end(), nx * ny);
+    complete = p && p < mappedFile.end();
+  }
+  if (!complete) 
+  {
+    vtkDebugMacro(<<"Time step at "<<last.time<<" is still being written")
+    unfinishedStep = last.offset;
+    stepIndex.pop_back();
+  }
+}
+
+// Follow mode: indexes the steps that were appended since the file was indexed.
+// first is set to the first step that was indexed again, stepIndex.size() if none.
+int UTChemAsciiReader::updateTimeStepIndex(unsigned& first)
+{
+  long long size = 0, mtime = 0;
+  first = 0;
+  if (stepIndex.empty() || stepIndex.back().offset < 0 || !UTChemMappedFile::stat(FileName, size, mtime)) 
+  {
+    return buildTimeStepIndex(); // nothing to resume from (e.g. PROF files)
+  }
+  if (size == indexedBytes) 
+  {
+    first = stepIndex.size();
+    return 1; // nothing new
+  }
+  if (size < indexedBytes) 
+  {
+    return buildTimeStepIndex(); // rewritten, start over
+  }
+
+  stopPrefetch();
+  if (!initializeStream()) 
+  {
+    return 0;
+  }
+
+  // The last indexed step is indexed again, its size is not known until the next one starts
+  first = stepIndex.size() - 1;
+  std::streamoff resume = stepIndex.back().offset;
+  freeTimeStep(first);
+  stepIndex.pop_back();
+
+  bool failed = false;
+  try {
+    cursor = mappedFile.begin() + resume;
+    scanTimeSteps();
+    dropIncompleteLastStep();
+  } catch (const std::exception& e) {
+    failed = true;
+    vtkErrorMacro(<<"Exception :" <<e.what());
+  }
+  indexedBytes = mappedFile.size();
+  closeStream();
+
+  if (failed || stepIndex.empty()) 
+  {
+    freeDataVectors();
+    return 0;
+  }
+
+  timeList.resize(first);
+  for (unsigned i = first; i < stepIndex.size(); ++i) 
+  {
+    timeList.push_back(stepIndex[i].time);
+  }
+  allData.resize(stepIndex.size(), NULL);
+
+  vtkDebugMacro(<<"Following "<<FileName<<": "<<stepIndex.size()<<" time steps")
+  return validFileRead();
+}
+
+// Seeks to an indexed time step and parses it up to the next indexed step (or TIME line)
+int UTChemAsciiReader::readTimeStep(unsigned idx)
+{
+  if (idx >= stepIndex.size() || idx >= allData.size()) 
+  {
+    return 0;
+  }
+  if (allData[idx]) 
+  {
+    return 1; // already decoded
+  }
+  if (readTimeStepFromSidecar(idx)) 
+  {
+    return 1;
+  }
+  if (stepIndex[idx].offset < 0 || !initializeStream()) 
+  {
+    return 0;
+  }
+
+  bool failed = false;
+  const TimeStepEntry& entry = stepIndex[idx];
+
+  currentTimeStep = new IntegerTovtkFloatArrayMap();
+  allData[idx] = currentTimeStep;
+  time = entry.time;
+  timestep = idx + 1;
+  layer = 0;
+  skippedBlocks = false;
+  layersRead.clear();
+
+  try {
+    if (entry.offset > (std::streamoff) mappedFile.size()) 
+    {
+      throw std::runtime_error("Time step offset is past the end of the file");
+    }
+    cursor = mappedFile.begin() + entry.offset;
+
+    const char* stepEnd = mappedFile.end();
+    if (idx + 1 < stepIndex.size() && stepIndex[idx + 1].offset > entry.offset
+        && stepIndex[idx + 1].offset <= (std::streamoff) mappedFile.size()) 
+    {
+      stepEnd = mappedFile.begin() + stepIndex[idx + 1].offset;
+    }
+    else if (unfinishedStep > entry.offset && unfinishedStep <= (std::streamoff) mappedFile.size()) 
+    {
+      stepEnd = mappedFile.begin() + unfinishedStep; // not indexed yet, still being written
+    }
+
+    if (!entry.blocks.empty()) 
+    {
+      decodeTimeStepBlocks(entry, stepEnd);
+    }
+    else 
+    {
+      bool seenTime = false;
+      int linesParsed = 0;
+      while (cursor < stepEnd) 
+      {
+        const char* c_str = readNextLine(false);
+
+        if (reachedEnd) 
+        {
+          break;
+        }
+
+        while (*c_str == ' ') 
+        {
+          c_str++;
+        }
+
+        if (!*c_str) 
+        {
+          continue;
+        }
+
+        double t = 0;
+        if (isTimeStepLine(c_str, t)) 
+        {
+          if (seenTime || linesParsed) 
+          {
+            break; // start of the next time step
+          }
+          seenTime = true;
+          continue;
+        }
+
+        if (!parseLine(c_str)) 
+        {
+          vtkDecodeErrorMacro(<<"Could not parse line:'"<<nextLine<<"' in time step "<<idx);
+          throw std::runtime_error("Parse failed");
+        }
+        linesParsed++;
+      }
+    }
+  } catch (const std::exception& e) {
+    failed = true;
+    vtkDecodeErrorMacro(<<"Exception :" <<e.what());
+  }
+
+  closeStream();
+
+  if (!failed) 
+  {
+    fillUnreadLayers();
+  }
+  layersRead.clear();
+  currentTimeStep = NULL;
+
+  if (failed) 
+  {
+    freeTimeStep(idx);
+    return 0;
+  }
+  if (!skippedBlocks) 
+  {
+    writeSidecarStep(idx); // only complete steps are cached
+  }
+  return 1;
+}
+
+struct UTChemBlockDecodeJob
+{
+  std::vector<UTChemPendingBlock>* blocks;
+  int valuesPerBlock;
+};
+
+// Blocks are handed out round-robin; they all hold nx*ny values so the load is even
+static VTK_THREAD_RETURN_TYPE decodeBlocksThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  UTChemBlockDecodeJob* job = static_cast<UTChemBlockDecodeJob*>(info->UserData);
+  std::vector<UTChemPendingBlock>& blocks = *job->blocks;
+
+  for (size_t i = info->ThreadID; i < blocks.size(); i += info->NumberOfThreads) 
+  {
+    UTChemPendingBlock& block = blocks[i];
+    block.failed = NULL == scanFloats(block.begin, block.end, block.output, job->valuesPerBlock, block.notNumbers);
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Parses the block header lines of a time step in file order, so arrays are created
+// and named exactly as in a serial parse, then decodes all blocks in parallel.
+void UTChemAsciiReader::decodeTimeStepBlocks(const TimeStepEntry& entry, const char* stepEnd)
+{
+  const char* begin = mappedFile.begin();
+  pendingBlocks.clear();
+  deferBlocks = true;
+
+  try {
+    for (size_t b = 0; b < entry.blocks.size(); ++b) 
+    {
+      if (entry.blocks[b] < 0 || begin + entry.blocks[b] >= stepEnd) 
+      {
+        throw std::runtime_error("Block offset is outside of its time step");
+      }
+      cursor = begin + entry.blocks[b];
+      const char* c_str = readNextLine(true);
+      while (*c_str == ' ') 
+      {
+        c_str++;
+      }
+      size_t queued = pendingBlocks.size();
+      if (!parseLine(c_str)) 
+      {
+        vtkDecodeErrorMacro(<<"Could not parse line:'"<<nextLine<<"' in time step "<<(timestep - 1));
+        throw std::runtime_error("Parse failed");
+      }
+      if (pendingBlocks.size() > queued) 
+      {
+        pendingBlocks.back().end = (b + 1 < entry.blocks.size()) ? begin + entry.blocks[b + 1] : stepEnd;
+      }
+    }
+  } catch (...) {
+    deferBlocks = false;
+    pendingBlocks.clear();
+    throw;
+  }
+  deferBlocks = false;
+
+  UTChemBlockDecodeJob job;
+  job.blocks = &pendingBlocks;
+  job.valuesPerBlock = nx * ny;
+
+  int numThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  if (numThreads > (int) pendingBlocks.size()) 
+  {
+    numThreads = (int) pendingBlocks.size();
+  }
+  vtkMultiThreader* threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(numThreads > 0 ? numThreads : 1);
+  threader->SetSingleMethod(decodeBlocksThread, &job);
+  threader->SingleMethodExecute();
+  threader->Delete();
+
+  // Report in file order so messages don't depend on thread scheduling
+  bool failed = false;
+  for (size_t b = 0; b < pendingBlocks.size(); ++b) 
+  {
+    if (pendingBlocks[b].notNumbers) 
+    {
+      vtkDecodeErrorMacro(<<"Note: input file contains NaNs");
+    }
+    failed = failed || pendingBlocks[b].failed;
+  }
+  pendingBlocks.clear();
+
+  if (failed) 
+  {
+    throw std::runtime_error("Unexpected end of file while reading values");
+  }
+}
+
+// Steps can be dropped from memory if we know where to find them again
+bool UTChemAsciiReader::isReloadable(unsigned idx)
+{
+  if (idx >= stepIndex.size()) 
+  {
+    return false;
+  }
+  return stepIndex[idx].offset >= 0 || (Sidecar && Sidecar->hasStep(idx));
+}
+
+void UTChemAsciiReader::freeTimeStep(unsigned idx)
+{
+  if (idx >= allData.size() || !allData[idx]) 
+  {
+    return;
+  }
+  IntegerTovtkFloatArrayMap* scalars = allData[idx];
+  for (IntegerTovtkFloatArrayMap_it it = scalars->begin(); it != scalars->end(); it++) 
+  {
+    if ((*it).second) 
+    {
+      releaseArray((*it).first, (*it).second);
+    }
+  }
+  delete scalars;
+  allData[idx] = NULL;
+  stepUsage.remove(idx);
+}
+
+void UTChemAsciiReader::touchTimeStep(unsigned idx)
+{
+  stepUsage.remove(idx);
+  stepUsage.push_front(idx);
+}
+
+size_t UTChemAsciiReader::timeStepMemorySize(unsigned idx)
+{
+  size_t bytes = 0;
+  if (idx >= allData.size() || !allData[idx]) 
+  {
+    return 0;
+  }
+  IntegerTovtkFloatArrayMap* scalars = allData[idx];
+  for (IntegerTovtkFloatArrayMap_it it = scalars->begin(); it != scalars->end(); it++) 
+  {
+    if ((*it).second) 
+    {
+      bytes += (size_t) (*it).second->GetNumberOfTuples() * (*it).second->GetNumberOfComponents() * sizeof(float);
+    }
+  }
+  return bytes;
+}
+
+// The arenas are only used by the main thread: reusing a slot depends on reference
+// counts that the pipeline changes without DecodeLock. The prefetch thread decodes
+// into arrays of its own, which nothing else refers to until the step is published.
+vtkFloatArray* UTChemAsciiReader::acquireArray(int key)
+{
+  if (backgroundDecode) 
+  {
+    vtkFloatArray* array = vtkFloatArray::New();
+    array->SetNumberOfTuples((vtkIdType) nx * ny * nz);
+    return array;
+  }
+  UTChemArrayArena*& arena = arenas[key];
+  if (!arena) 
+  {
+    arena = new UTChemArrayArena((vtkIdType) nx * ny * nz);
+  }
+  return arena->acquire();
+}
+
+void UTChemAsciiReader::releaseArray(int key, vtkFloatArray* array)
+{
+  if (backgroundDecode) 
+  {
+    array->Delete(); // a failed prefetch, the array never left the thread
+    return;
+  }
+  std::map<int, UTChemArrayArena*>::iterator it = arenas.find(key);
+  if (it == arenas.end() || !(*it).second->release(array)) 
+  {
+    array->Delete(); // not from an arena (e.g. flux vectors)
+  }
+}
+
+// Arena slots are not initialized, so layers missing from the file are set to NaN here
+void UTChemAsciiReader::fillUnreadLayers()
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const vtkIdType layerSize = (vtkIdType) nx * ny;
+  for (std::map<int, std::vector<bool> >::iterator it = layersRead.begin(); it != layersRead.end(); it++) 
+  {
+    if (!currentTimeStep || !currentTimeStep->count((*it).first)) 
+    {
+      continue;
+    }
+    float* values = (*currentTimeStep)[(*it).first]->GetPointer(0);
+    for (int k = 0; k < (int) (*it).second.size(); ++k) 
+    {
+      if (!(*it).second[k]) 
+      {
+        std::fill(values + layerSize * k, values + layerSize * (k + 1), nan);
+      }
+    }
+  }
+}
+
+void UTChemAsciiReader::flushStepCache()
+{
+  stopPrefetch();
+  for (unsigned i = 0; i < allData.size(); ++i) 
+  {
+    if (isReloadable(i)) 
+    {
+      freeTimeStep(i);
+    }
+  }
+}
+
+// Queues the next PrefetchSteps steps in the playback direction and makes sure a
+// thread is working on them
+void UTChemAsciiReader::startPrefetch(unsigned served)
+{
+  std::vector<unsigned> queue;
+  for (int i = 1; i <= PrefetchSteps; ++i) 
+  {
+    int idx = (int) served + i * playDirection;
+    if (idx < 0 || idx >= (int) allData.size()) 
+    {
+      break;
+    }
+    queue.push_back((unsigned) idx);
+  }
+
+  DecodeLock->Lock();
+  prefetchQueue = queue;
+  bool spawn = !prefetchRunning && !queue.empty();
+  if (spawn) 
+  {
+    prefetchRunning = true;
+  }
+  DecodeLock->Unlock();
+
+  if (spawn) 
+  {
+    if (prefetchThreadId >= 0) 
+    {
+      PrefetchThreader->TerminateThread(prefetchThreadId); // joins the finished thread
+    }
+    prefetchThreadId = PrefetchThreader->SpawnThread(&UTChemAsciiReader::PrefetchThread, this);
+  }
+}
+
+void UTChemAsciiReader::stopPrefetch()
+{
+  if (prefetchThreadId < 0) 
+  {
+    return;
+  }
+  PrefetchThreader->TerminateThread(prefetchThreadId);
+  prefetchThreadId = -1;
+  prefetchRunning = false;
+  prefetchQueue.clear();
+  reportDeferredMessages();
+}
+
+// Decodes queued steps one at a time under DecodeLock, so RequestData only waits
+// for a step that is already being decoded
+VTK_THREAD_RETURN_TYPE UTChemAsciiReader::PrefetchThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  UTChemAsciiReader* self = static_cast<UTChemAsciiReader*>(info->UserData);
+
+  while (true) 
+  {
+    info->ActiveFlagLock->Lock();
+    int active = *info->ActiveFlag;
+    info->ActiveFlagLock->Unlock();
+    if (!active) 
+    {
+      break; // cancelled by stopPrefetch
+    }
+
+    self->DecodeLock->Lock();
+    if (self->prefetchQueue.empty()) 
+    {
+      self->prefetchRunning = false;
+      self->DecodeLock->Unlock();
+      break;
+    }
+    unsigned idx = self->prefetchQueue.front();
+    self->prefetchQueue.erase(self->prefetchQueue.begin());
+    // Only decoding happens here. Eviction (and with it any release of arrays that
+    // outputs may still hold) is left to RequestData on the main thread.
+    self->backgroundDecode = true;
+    self->deferMessages = true;
+    if (idx < self->allData.size() && !self->allData[idx] && self->readTimeStep(idx)) 
+    {
+      self->touchTimeStep(idx);
+      if (self->GetDebug()) 
+      {
+        std::ostringstream msg;
+        msg << "Prefetched time step index " << idx;
+        self->deferredMessages.push_back(std::make_pair(false, msg.str()));
+      }
+    }
+    self->deferMessages = false;
+    self->backgroundDecode = false;
+    self->DecodeLock->Unlock();
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// Messages the prefetch thread kept back, reported in the order they were made
+void UTChemAsciiReader::reportDeferredMessages()
+{
+  std::vector<std::pair<bool, std::string> > messages;
+  DecodeLock->Lock();
+  messages.swap(deferredMessages);
+  DecodeLock->Unlock();
+  for (size_t i = 0; i < messages.size(); ++i) 
+  {
+    if (messages[i].first) 
+    {
+      vtkErrorMacro(<< messages[i].second)
+    }
+    else 
+    {
+      vtkDebugMacro(<< messages[i].second)
+    }
+  }
+}
+
+// Runs the block header lines of the indexed steps from first on through parseLine in
+// listing mode, so that array names are known before any values are decoded
+void UTChemAsciiReader::collectArrayNames(unsigned first)
+{
+  if (first == 0) 
+  {
+    listedArrays.clear();
+  }
+  bool hasBlocks = false;
+  for (unsigned i = first; i < stepIndex.size() && !hasBlocks; ++i) 
+  {
+    hasBlocks = !stepIndex[i].blocks.empty();
+  }
+  if (!hasBlocks) 
+  {
+    return;
+  }
+  stopPrefetch(); // the stream and the parsing state are used without DecodeLock
+  if (!initializeStream()) 
+  {
+    return;
+  }
+
+  listArraysOnly = true;
+  try {
+    for (unsigned i = first; i < stepIndex.size(); ++i) 
+    {
+      for (size_t b = 0; b < stepIndex[i].blocks.size(); ++b) 
+      {
+        if (stepIndex[i].blocks[b] < 0 || stepIndex[i].blocks[b] >= (std::streamoff) mappedFile.size()) 
+        {
+          throw std::runtime_error("Block offset is past the end of the file");
+        }
+        cursor = mappedFile.begin() + stepIndex[i].blocks[b];
+        const char* c_str = readNextLine(true);
+        while (*c_str == ' ') 
+        {
+          c_str++;
+        }
+        parseLine(c_str);
+      }
+    }
+  } catch (const std::exception& e) {
+    vtkErrorMacro(<<"Exception :" <<e.what());
+  }
+  listArraysOnly = false;
+
+  closeStream();
+}
+
+// Fortran writes the blocks with a fixed format (e.g. 1X,8E11.4), so the line and
+// column of a value follow from its position in the layer. The layout is taken from
+// the first line and only trusted if it accounts for the exact size of the block.
+// Returns false if the block does not have such a layout.
+static bool scanFixedWidthCells(const char* p, const char* end, int count,
+                                const std::vector<std::pair<vtkIdType, size_t> >& cells, float* output)
+{
+  const char* eol = (const char*) memchr(p, '\n', end - p);
+  if (!eol) 
+  {
+    return false;
+  }
+  const char* contentEnd = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+  const ptrdiff_t stride = eol + 1 - p;
+  const ptrdiff_t eolSize = eol + 1 - contentEnd;
+
+  // Token ends must be evenly spaced, the spacing is the field width
+  int perLine = 0;
+  ptrdiff_t first = 0, width = 0;
+  for (const char* q = scanSkipSpace(p, contentEnd); q < contentEnd; q = scanSkipSpace(q, contentEnd)) 
+  {
+    q = scanSkipToken(q, contentEnd);
+    const ptrdiff_t tokenEnd = q - p;
+    if (perLine == 0) 
+    {
+      first = tokenEnd;
+    }
+    else if (perLine == 1) 
+    {
+      width = tokenEnd - first;
+    }
+    else if (tokenEnd - first != perLine * width) 
+    {
+      return false;
+    }
+    perLine++;
+  }
+  if (perLine == 1) 
+  {
+    width = first;
+  }
+  const ptrdiff_t prefix = first - width;
+  if (perLine == 0 || width <= 0 || prefix < 0 || contentEnd - p != prefix + perLine * width) 
+  {
+    return false;
+  }
+
+  const int fullLines = count / perLine;
+  const int rest = count % perLine;
+  if (end - p != fullLines * stride + (rest ? prefix + rest * width + eolSize : 0)) 
+  {
+    return false;
+  }
+
+  for (size_t c = 0; c < cells.size(); ++c) 
+  {
+    const vtkIdType line = cells[c].first / perLine;
+    const char* lineStart = p + line * stride;
+    const char* lineEnd = (line < fullLines) ? lineStart + stride : end;
+    if (lineEnd[-1] != '\n') 
+    {
+      return false; // lines of different length
+    }
+    const char* field = lineStart + prefix + (cells[c].first % perLine) * width;
+    bool isNumber;
+    if (scanFloat(field, field + width, output[cells[c].second], isNumber) != field + width) 
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Scans up to each wanted value of a block, skipping the others without converting them.
+// cells are (position in the layer, index into output) sorted by position.
+static bool scanSequentialCells(const char* p, const char* end,
+                                const std::vector<std::pair<vtkIdType, size_t> >& cells, float* output)
+{
+  vtkIdType at = 0; // position of the value at p
+  for (size_t c = 0; c < cells.size(); ++c) 
+  {
+    if (cells[c].first < at) 
+    {
+      output[cells[c].second] = output[cells[c - 1].second]; // same cell twice
+      continue;
+    }
+    if (cells[c].first > at) 
+    {
+      p = scanSkipValues(p, end, (int) (cells[c].first - at));
+      if (!p) 
+      {
+        return false;
+      }
+    }
+    bool isNumber;
+    const char* next = scanFloat(p, end, output[cells[c].second], isNumber);
+    if (next == p) 
+    {
+      return false;
+    }
+    p = next;
+    at = cells[c].first + 1;
+  }
+  return true;
+}
+
+// Block headers of every indexed step go through parseLine in listing mode (as in
+// collectArrayNames) to learn array and layer; values are only read from the blocks
+// of layers that hold one of the cells. Steps that were indexed without their
+// blocks are decoded in full.
+int UTChemAsciiReader::readCellValues(UTChemCellSeries& series)
+{
+  series.times = timeList;
+  series.names.clear();
+  series.values.clear();
+
+  const size_t cellCount = series.cells.size();
+  const vtkIdType layerSize = (vtkIdType) nx * ny;
+  if (cellCount == 0 || layerSize <= 0 || nz <= 0 || stepIndex.empty()) 
+  {
+    return 0;
+  }
+
+  // Wanted cells of each layer, (position in the layer, cell) sorted by position
+  std::vector<std::vector<std::pair<vtkIdType, size_t> > > layerCells(nz);
+  for (size_t c = 0; c < cellCount; ++c) 
+  {
+    const vtkIdType id = series.cells[c];
+    if (id < 0 || id >= layerSize * nz) 
+    {
+      vtkWarningMacro(<<"Cell " << id << " is outside of the grid");
+      continue;
+    }
+    layerCells[id / layerSize].push_back(std::make_pair(id % layerSize, c));
+  }
+  for (int k = 0; k < nz; ++k) 
+  {
+    std::sort(layerCells[k].begin(), layerCells[k].end());
+  }
+
+  std::map<std::string, size_t> arrayIndex;
+  const size_t steps = stepIndex.size();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<unsigned> unindexed;
+  bool failed = false;
+
+  stopPrefetch(); // the stream and the decoded steps are used without DecodeLock
+  if (!initializeStream()) 
+  {
+    return 0;
+  }
+  const char* begin = mappedFile.begin();
+  listArraysOnly = true;
+  try {
+    for (unsigned i = 0; i < steps; ++i) 
+    {
+      const TimeStepEntry& entry = stepIndex[i];
+      if (entry.blocks.empty()) 
+      {
+        unindexed.push_back(i);
+        continue;
+      }
+      const char* stepEnd = mappedFile.end();
+      if (i + 1 < steps && stepIndex[i + 1].offset > entry.offset
+          && stepIndex[i + 1].offset <= (std::streamoff) mappedFile.size()) 
+      {
+        stepEnd = begin + stepIndex[i + 1].offset;
+      }
+      else if (unfinishedStep > entry.offset && unfinishedStep <= (std::streamoff) mappedFile.size()) 
+      {
+        stepEnd = begin + unfinishedStep;
+      }
+
+      for (size_t b = 0; b < entry.blocks.size(); ++b) 
+      {
+        if (entry.blocks[b] < 0 || begin + entry.blocks[b] >= stepEnd) 
+        {
+          throw std::runtime_error("Block offset is outside of its time step");
+        }
+        cursor = begin + entry.blocks[b];
+        const char* c_str = readNextLine(true);
+        while (*c_str == ' ') 
+        {
+          c_str++;
+        }
+        listedArrayName.clear();
+        layer = 0;
+        parseLine(c_str);
+        if (listedArrayName.empty() || layer <= 0 || layer > nz || layerCells[layer - 1].empty()) 
+        {
+          continue;
+        }
+
+        std::map<std::string, size_t>::iterator it = arrayIndex.find(listedArrayName);
+        if (it == arrayIndex.end()) 
+        {
+          it = arrayIndex.insert(std::make_pair(listedArrayName, series.names.size())).first;
+          series.names.push_back(listedArrayName);
+          series.values.push_back(std::vector<float>(steps * cellCount, nan));
+        }
+        float* output = &series.values[it->second][i * cellCount];
+        const char* blockEnd = (b + 1 < entry.blocks.size()) ? begin + entry.blocks[b + 1] : stepEnd;
+        const std::vector<std::pair<vtkIdType, size_t> >& cells = layerCells[layer - 1];
+        if (!scanFixedWidthCells(cursor, blockEnd, (int) layerSize, cells, output)
+            && !scanSequentialCells(cursor, blockEnd, cells, output)) 
+        {
+          throw std::runtime_error("Unexpected end of block while reading values");
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    failed = true;
+    vtkErrorMacro(<<"Exception :" <<e.what());
+  }
+  listArraysOnly = false;
+  closeStream();
+
+  for (size_t u = 0; u < unindexed.size() && !failed; ++u) 
+  {
+    const unsigned idx = unindexed[u];
+    const bool wasDecoded = idx < allData.size() && allData[idx] != NULL;
+    if (!readTimeStep(idx)) 
+    {
+      continue;
+    }
+    for (IntegerTovtkFloatArrayMap_it a = allData[idx]->begin(); a != allData[idx]->end(); ++a) 
+    {
+      const std::string name(a->second->GetName() ? a->second->GetName() : "");
+      std::map<std::string, size_t>::iterator it = arrayIndex.find(name);
+      if (it == arrayIndex.end()) 
+      {
+        it = arrayIndex.insert(std::make_pair(name, series.names.size())).first;
+        series.names.push_back(name);
+        series.values.push_back(std::vector<float>(steps * cellCount, nan));
+      }
+      for (size_t c = 0; c < cellCount; ++c) 
+      {
+        if (series.cells[c] >= 0 && series.cells[c] < a->second->GetNumberOfTuples()) 
+        {
+          series.values[it->second][idx * cellCount + c] = a->second->GetValue(series.cells[c]);
+        }
+      }
+    }
+    if (!wasDecoded) 
+    {
+      freeTimeStep(idx);
+    }
+  }
+  return !failed;
+}
+
+// Walks from the most recently used step and frees the reloadable ones that no longer fit
+void UTChemAsciiReader::trimStepCache(unsigned keep)
+{
+  const double budget = StepCacheSize * 1048576.0;
+  double used = 0;
+  std::vector<unsigned> evict;
+
+  for (std::list<unsigned>::iterator it = stepUsage.begin(); it != stepUsage.end(); it++) 
+  {
+    used += timeStepMemorySize(*it);
+    if (used > budget && *it != keep && isReloadable(*it)) 
+    {
+      used -= timeStepMemorySize(*it);
+      evict.push_back(*it);
+    }
+  }
+
+  for (unsigned i = 0; i < evict.size(); ++i) 
+  {
+    vtkDecodeDebugMacro(<< "Step cache: evicting time step index " << evict[i])
+    freeTimeStep(evict[i]);
+  }
+  for (std::map<int, UTChemArrayArena*>::iterator it = arenas.begin(); it != arenas.end(); it++) 
+  {
+    (*it).second->freeIdleChunks(); // slots of steps evicted earlier that VTK no longer holds
+  }
+}
+
+// Uses FILE.rva instead of the pre-scan when it was written for this exact file
+int UTChemAsciiReader::loadSidecarIndex()
+{
+  delete Sidecar;
+  Sidecar = new UTChemSidecar(FileName);
+
+  if (!InputInfo || !Sidecar->open(InputInfo->nx, InputInfo->ny, InputInfo->nz)) 
+  {
+    return 0;
+  }
+
+  file_ext = getFileExtension(FileName);
+  nx = InputInfo->nx;
+  ny = InputInfo->ny;
+  nz = InputInfo->nz;
+  stepIndex = Sidecar->getIndex();
+  for (unsigned i = 0; i < stepIndex.size(); ++i) 
+  {
+    timeList.push_back(stepIndex[i].time);
+  }
+  allData.resize(stepIndex.size(), NULL);
+
+  vtkDebugMacro(<<"Using sidecar index for "<<FileName<<" with "<<stepIndex.size()<<" time steps")
+  return 1;
+}
+
+// Reports the arrays stored with the sidecar index, as collectArrayNames would have
+int UTChemAsciiReader::listSidecarArrays()
+{
+  if (!Sidecar || !Sidecar->hasArrayList()) 
+  {
+    return 0;
+  }
+  listedArrays = Sidecar->getArrays();
+  listArraysOnly = true; // see UTChemConcReader::SelectionModifiedCallback
+  for (size_t i = 0; i < listedArrays.size(); ++i) 
+  {
+    addArrayName(listedArrays[i].name);
+  }
+  listArraysOnly = false;
+  return 1;
+}
+
+void UTChemAsciiReader::writeSidecarIndex()
+{
+  if (FollowFile) 
+  {
+    return; // the file is still growing, a sidecar would be out of date right away
+  }
+  if (sidecarReadOnly) 
+  {
+    return;
+  }
+  if (!Sidecar) 
+  {
+    Sidecar = new UTChemSidecar(FileName);
+  }
+  if (!Sidecar->create(nx, ny, nz, stepIndex, listedArrays)) 
+  {
+    vtkDebugMacro(<<"Could not write sidecar "<<UTChemSidecar::getSidecarFileName(FileName))
+  }
+}
+
+int UTChemAsciiReader::readTimeStepFromSidecar(unsigned idx)
+{
+  if (!Sidecar || !Sidecar->hasStep(idx)) 
+  {
+    return 0;
+  }
+
+  const std::vector<UTChemSidecar::Slab>& slabs = Sidecar->getStep(idx);
+  vtkIdType tuples = (vtkIdType) nx * ny * nz;
+  IntegerTovtkFloatArrayMap* scalars = new IntegerTovtkFloatArrayMap();
+
+  for (size_t i = 0; i < slabs.size(); ++i) 
+  {
+    if (!isArrayEnabled(slabs[i].name.c_str())) 
+    {
+      continue;
+    }
+    vtkFloatArray* floatArray;
+    if (slabs[i].components == 1) 
+    {
+      floatArray = acquireArray(slabs[i].key);
+    }
+    else 
+    {
+      floatArray = vtkFloatArray::New();
+      floatArray->SetNumberOfComponents(slabs[i].components);
+      floatArray->SetNumberOfTuples(tuples);
+    }
+    // Copied, not mapped: arena slots are reused and the sidecar may be rewritten
+    memcpy(floatArray->GetPointer(0), slabs[i].values, sizeof(float) * tuples * slabs[i].components);
+    floatArray->SetName(slabs[i].name.c_str());
+    (*scalars)[slabs[i].key] = floatArray;
+  }
+  allData[idx] = scalars;
+  return 1;
+}
+
+void UTChemAsciiReader::writeSidecarStep(unsigned idx)
+{
+  if (!CacheDecodedArrays || !Sidecar || idx >= allData.size() || !allData[idx]) 
+  {
+    return;
+  }
+
+  std::vector<UTChemSidecar::Slab> slabs;
+  IntegerTovtkFloatArrayMap_it it = allData[idx]->begin(), end = allData[idx]->end();
+  for (; it != end; it++) 
+  {
+    UTChemSidecar::Slab slab;
+    slab.key = (*it).first;
+    slab.components = (*it).second->GetNumberOfComponents();
+    slab.name = (*it).second->GetName() ? (*it).second->GetName() : "";
+    slab.values = (*it).second->GetPointer(0);
+    slabs.push_back(slab);
+  }
+
+  if (!Sidecar->appendStep(idx, slabs)) 
+  {
+    vtkDecodeDebugMacro(<<"Could not cache time step "<<idx<<" in sidecar")
+  }
+}
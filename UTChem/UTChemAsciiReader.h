@@ -19,21 +19,62 @@ PURPOSE.  See the above copyright notice for more information.
 #define __UTChemAsciiReader_h
 
 #include <fstream>
+#include <sstream>
 #include <utility>
 #include <vector>
 #include <string>
 #include <map>
+#include <list>
 
 #include "vtkAlgorithm.h"
 #include "vtkDataObject.h"
 #include "vtkFloatArray.h"
 #include "vtkDataSet.h"
+#include "vtkMultiThreader.h"
+#include "vtkTimeStamp.h"
+
+#include "UTChemMappedFile.h"
+#include "UTChemSidecar.h"
+#include "UTChemArrayArena.h"
 
 struct UTChemInputReader;
+class vtkMutexLock;
 
 typedef  std::map<int,vtkFloatArray*> IntegerTovtkFloatArrayMap;
 typedef  std::map<int,vtkFloatArray*>::iterator IntegerTovtkFloatArrayMap_it;
 
+//BTX
+// One block of nx*ny numbers queued for decoding on a worker thread
+struct UTChemPendingBlock
+{
+  const char* begin; // first character after the block header line
+  const char* end;   // start of the next block header (or time step)
+  float* output;     // nx*ny slice of the destination array
+  int notNumbers;
+  bool failed;
+};
+
+// Values of a few cells at every time step, see UTChemAsciiReader::readCellValues
+struct UTChemCellSeries
+{
+  std::vector<vtkIdType> cells; // i + j*nx + k*nx*ny (0-based), filled by the caller
+  std::vector<double> times;
+  std::vector<std::string> names; // arrays in order of appearance
+  std::vector<std::vector<float> > values; // per array, [step * cells.size() + cell], NaN where a step lacks it
+};
+
+// For code that also runs on worker threads (prefetching, UTChemWellSetReader). Only the
+// main thread may use the output window, so messages of workers are kept in deferredMessages.
+#define vtkDecodeErrorMacro(x) \
+  { if (this->deferMessages) { std::ostringstream vtkmsg; vtkmsg x; \
+      this->deferredMessages.push_back(std::make_pair(true, vtkmsg.str())); } \
+    else vtkErrorMacro(x) }
+#define vtkDecodeDebugMacro(x) \
+  { if (this->deferMessages) { if (this->GetDebug()) { std::ostringstream vtkmsg; vtkmsg x; \
+      this->deferredMessages.push_back(std::make_pair(false, vtkmsg.str())); } } \
+    else vtkDebugMacro(x) }
+//ETX
+
 
 class VTK_EXPORT UTChemAsciiReader : public vtkAlgorithm {
 public:
@@ -46,6 +87,39 @@ public:
   vtkSetStringMacro(FileName);
   vtkGetStringMacro(FileName);
 
+  // Description:
+  // Append decoded arrays to the FILE.rva sidecar so that later opens of
+  // the same (unchanged) file skip ASCII parsing. Off by default.
+  vtkSetMacro(CacheDecodedArrays, int);
+  vtkGetMacro(CacheDecodedArrays, int);
+  vtkBooleanMacro(CacheDecodedArrays, int);
+
+  // Description:
+  // Memory budget (in MB) for decoded time steps. The least recently shown
+  // steps beyond the budget are dropped and decoded again from the file
+  // when they are requested. The step being shown is always kept.
+  vtkSetClampMacro(StepCacheSize, int, 0, VTK_INT_MAX);
+  vtkGetMacro(StepCacheSize, int);
+
+  // Description:
+  // Number of time steps to decode in the background, in the direction of
+  // playback, after a step has been served. 0 disables prefetching.
+  vtkSetClampMacro(PrefetchSteps, int, 0, 16);
+  vtkGetMacro(PrefetchSteps, int);
+
+  // Description:
+  // Follow a file that is still being written by a running simulation.
+  // The file is checked on every update and only the time steps (or
+  // table rows) appended since the last check are read.
+  vtkSetMacro(FollowFile, int);
+  vtkGetMacro(FollowFile, int);
+  vtkBooleanMacro(FollowFile, int);
+
+  // Description:
+  // In follow mode this includes changes of the file on disk, so that the
+  // pipeline asks for information again when the file grows.
+  virtual unsigned long GetMTime();
+
 protected:
   UTChemAsciiReader();
   virtual ~UTChemAsciiReader();
@@ -58,12 +132,67 @@ protected:
   virtual int ProcessRequest(vtkInformation* request, vtkInformationVector** inputVector, vtkInformationVector* outputVector);
 
   char* FileName;
+  int CacheDecodedArrays;
+  int StepCacheSize;
+  int PrefetchSteps;
+  int FollowFile;
 protected:
   //BTX
   virtual int readFile();
 
+  // Pre-scan and lazy decoding of individual time steps
+  typedef UTChemTimeStepEntry TimeStepEntry;
+  virtual int buildTimeStepIndex(); // 0 if failed, 1 if at least one time step was found
+  virtual int readTimeStep(unsigned idx); // decodes one indexed time step into allData[idx]
+  virtual int isTimeStepLine(const char* c_str, double& t); // 1 and sets t if line starts a time step
+  virtual int isBlockHeaderLine(const char* c_str); // 1 if line heads a block of nx*ny values
+  virtual void indexLine(const char* c_str, std::streamoff offset); // adds steps and blocks to stepIndex
+  bool isReloadable(unsigned idx);
+  void freeTimeStep(unsigned idx);
+
+  // LRU bookkeeping for decoded time steps (see StepCacheSize)
+  void touchTimeStep(unsigned idx); // marks idx as most recently used
+  void trimStepCache(unsigned keep); // frees least recently used reloadable steps over budget
+  size_t timeStepMemorySize(unsigned idx);
+  void flushStepCache(); // frees every reloadable step
+
+  // Arena storage of the decoded arrays, one arena per variable
+  vtkFloatArray* acquireArray(int key); // nx*ny*nz values, not initialized
+  void releaseArray(int key, vtkFloatArray* array);
+  void fillUnreadLayers(); // NaN for layers the current step did not contain
+
+  // Follow mode
+  virtual int updateTimeStepIndex(unsigned& first); // indexes steps appended since the last call, 0 if failed
+  void scanTimeSteps(); // indexes from cursor to the end of the mapped file
+  virtual void dropIncompleteLastStep(); // while the writer is still busy with it
+  int readAppendedLines(); // readFile, resuming at followOffset
+  void parseRemainingLines(); // parseLine for every complete line from cursor on
+
+  // Background prefetch of the steps following the one being shown
+  void startPrefetch(unsigned served);
+  void stopPrefetch(); // cancels queued work and waits for the step being decoded
+  static VTK_THREAD_RETURN_TYPE PrefetchThread(void* arg);
+  void reportDeferredMessages(); // main thread only, see vtkDecodeErrorMacro
+
+  // Array selection hooks (see UTChemConcReader)
+  virtual void collectArrayNames(unsigned first = 0); // parses the block headers of steps from first on without decoding values
+  virtual void addArrayName(const std::string& vtkNotUsed(name)) {}
+  virtual int isArrayEnabled(const char* vtkNotUsed(name)) { return 1; }
+  void decodeTimeStepBlocks(const TimeStepEntry& entry, const char* stepEnd); // parallel decode, throws on failure
+
+  // Time series of single cells, reading only the layers that hold them
+  int readCellValues(UTChemCellSeries& series); // 0 if failed
+
+  // FILE.rva sidecar holding the index and (optionally) decoded arrays
+  int loadSidecarIndex(); // 1 if a valid sidecar replaced the pre-scan
+  int listSidecarArrays(); // 1 if the sidecar held the array names, collectArrayNames is not needed then
+  void writeSidecarIndex(); // stores the index and listedArrays
+  int readTimeStepFromSidecar(unsigned idx);
+  void writeSidecarStep(unsigned idx);
+
 // internal functions for readFile
-  virtual int initializeStream();
+  virtual int initializeStream(); // maps FileName and points cursor at its start
+  void closeStream();
   virtual void readHeader()=0; // throws exception if invalid nx,ny,nz
   virtual int parseLine(const char*)=0;// Returns 1 if line was eaten, 0 otherwise (failed). May also throw an std:ex if we choke on the line 
   virtual bool validFileRead(); // after file parsing is complete, checks that we have a data structure to display
@@ -73,7 +202,9 @@ protected:
   static  std::string getInputFileFromFileName(const char* filename);
   virtual int readLayerValues(std::string name = "", bool absolutePhase = true); // reads NX*NY  numerical values
   virtual void setMeaningfulArrayName(vtkFloatArray* array,int thePhase, std::string name = "", bool absolutePhase = true);
+  virtual std::string getMeaningfulArrayName(int thePhase, std::string name = "", bool absolutePhase = true);
   virtual void readNXNYnumericalValuesIntoArray(float*receivingArray);
+  void skipNXNYnumericalValues();
   virtual unsigned findClosestTimeStep(double& reqTime);
   virtual int buildVTKObject(const unsigned& bestidx, vtkInformation* outInfo);
   virtual int buildImageData(vtkDataSet * dataSet);
@@ -85,13 +216,38 @@ protected:
   void reloadInputFile(const char*filename);
 
   const char* readNextLine(bool mustBeNonEmpty);
+  // Same as readNextLine but returns the line in place inside the mapped file
+  const char* readNextRawLine(const char*& lineEnd, bool mustBeNonEmpty);
 
   // Methods to add well VOI information to the object
   void setWellVOI(vtkDataObject* dataObj);
   void calculateWellVOI(float[6]);
 
   IntegerTovtkFloatArrayMap* currentTimeStep;
-  std::vector<IntegerTovtkFloatArrayMap* > allData;
+  std::vector<IntegerTovtkFloatArrayMap* > allData; // NULL entries have not been decoded yet
+  std::vector<TimeStepEntry> stepIndex;
+  std::list<unsigned> stepUsage; // decoded steps, most recently used first
+  std::map<int, UTChemArrayArena*> arenas;
+  std::map<int, std::vector<bool> > layersRead; // per array of the step being decoded
+  unsigned long stepCacheHits, stepCacheMisses;
+
+  vtkMultiThreader* PrefetchThreader;
+  vtkMutexLock* DecodeLock; // guards parsing state, allData and stepUsage while prefetching
+  int prefetchThreadId; // -1 if no thread was spawned
+  bool prefetchRunning; // cleared by the thread when its queue is empty
+  std::vector<unsigned> prefetchQueue;
+  unsigned servedStep;
+  int lastRequestedStep;
+  int playDirection; // +1 forwards, -1 backwards
+  bool backgroundDecode; // set while the prefetch thread decodes, see acquireArray
+  bool deferMessages; // set while a worker thread parses
+  std::vector<std::pair<bool, std::string> > deferredMessages; // (error, text) of the worker thread
+
+  long long observedSize, observedMTime; // file state last seen by GetMTime
+  vtkTimeStamp FileChangeTime;
+  std::streamoff indexedBytes; // size of the file when it was last indexed
+  std::streamoff followOffset; // start of the first line readFile did not parse
+  std::streamoff unfinishedStep; // offset of the step dropped by dropIncompleteLastStep, -1 if none
 
   std::vector<double> timeList; // must be double, as we pass the bare double[] to Paraview
   std::map<int,std::string> componentNames;
@@ -99,7 +255,9 @@ protected:
 
   int nx, ny, nz;
   std::string file_ext;
-  std::ifstream stream;
+  UTChemMappedFile mappedFile;
+  const char* cursor; // parse position inside mappedFile
+  bool reachedEnd; // set by readNextLine once the whole file was consumed
   int line_num;
   double fileLength;
 
@@ -107,6 +265,8 @@ protected:
   vtkDataObject * dataObj;
 
   UTChemInputReader * InputInfo;
+  UTChemSidecar * Sidecar;
+  bool sidecarReadOnly; // an existing sidecar is used but none is written
 
   // Parsing state:
   std::string nextLine;
@@ -114,12 +274,20 @@ protected:
   float inj;
   double time;
   float* oneGrid; // Current set of nx*ny*nz points
+  bool deferBlocks; // readNXNYnumericalValuesIntoArray queues blocks instead of decoding them
+  std::vector<UTChemPendingBlock> pendingBlocks;
+  bool listArraysOnly; // readLayerValues only reports array names (see collectArrayNames)
+  std::string listedArrayName; // name readLayerValues last reported in listing mode
+  std::vector<UTChemSidecar::ArrayLayers> listedArrays; // every array reported in listing mode and its layers
+  bool skippedBlocks; // blocks of disabled arrays were skipped in the current step
   char phaseName[100];
 
   private:
   UTChemAsciiReader(const UTChemAsciiReader&); // Not implemented.
   void operator=(const UTChemAsciiReader&); // Not implemented.
 
+  friend class UTChemCellSeriesReader; // reads single cells of a file
+
   //ETX
 };
 #endif
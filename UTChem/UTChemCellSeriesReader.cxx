@@ -0,0 +1,180 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemCellSeriesReader
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+// Include our header
+#include "UTChemCellSeriesReader.h"
+#include "UTChemConcReader.h"
+#include "UTChemInputReader.h"
+
+// Standard libraries
+#include <map>
+#include <sstream>
+#include <string>
+
+// Useful vtk/paraview headers
+#include "vtkDoubleArray.h"
+#include "vtkFloatArray.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkTable.h"
+
+// --------------------------------------------------------
+vtkStandardNewMacro(UTChemCellSeriesReader);
+
+UTChemCellSeriesReader::UTChemCellSeriesReader() : FileName(NULL), WellId(0)
+{
+    this->SetNumberOfInputPorts(0);
+}
+
+UTChemCellSeriesReader::~UTChemCellSeriesReader()
+{
+    this->SetFileName(NULL);
+}
+
+void UTChemCellSeriesReader::PrintSelf(ostream& os, vtkIndent indent)
+{
+    os << indent << "File name: " << (FileName ? FileName : "(none)") << "\n";
+    os << indent << "Cells: " << GetNumberOfCells() << "\n";
+    os << indent << "WellId: " << WellId << "\n";
+    Superclass::PrintSelf(os, indent);
+}
+
+void UTChemCellSeriesReader::AddCell(int i, int j, int k)
+{
+    Cells.push_back(i);
+    Cells.push_back(j);
+    Cells.push_back(k);
+    this->Modified();
+}
+
+void UTChemCellSeriesReader::RemoveAllCells()
+{
+    if (!Cells.empty()) {
+        Cells.clear();
+        this->Modified();
+    }
+}
+
+int UTChemCellSeriesReader::RequestData(vtkInformation* vtkNotUsed(request),
+                                          vtkInformationVector** vtkNotUsed(inputVector),
+                                          vtkInformationVector* outputVector)
+{
+    vtkTable* table = vtkTable::SafeDownCast(
+        outputVector->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
+
+    if (!FileName || !table) {
+        return 0;
+    }
+
+    UTChemConcReader* reader = UTChemConcReader::New();
+    UTChemAsciiReader* file = reader; // the members we need are those of the base class
+    reader->SetCacheDecodedArrays(0); // only the index is needed
+    if (!reader->CanReadFile(FileName)) {
+        vtkErrorMacro(<<"Can not read " << FileName);
+        reader->Delete();
+        return 0;
+    }
+    reader->SetFileName(FileName);
+    if (!file->buildTimeStepIndex()) {
+        vtkErrorMacro(<<"No time steps found in " << FileName);
+        reader->Delete();
+        return 0;
+    }
+    this->UpdateProgress(0.1);
+
+    const UTChemInputReader* deck = file->InputInfo;
+    const int nx = deck->nx, ny = deck->ny, nz = deck->nz;
+
+    // Selected cells first, then the cells of the well
+    std::vector<int> ijk;
+    for (size_t c = 0; c + 2 < Cells.size(); c += 3) {
+        if (Cells[c] < 1 || Cells[c] > nx || Cells[c + 1] < 1 || Cells[c + 1] > ny || Cells[c + 2] < 1 || Cells[c + 2] > nz) {
+            vtkWarningMacro(<<"Skipping cell (" << Cells[c] << "," << Cells[c + 1] << "," << Cells[c + 2] << "), it is outside of the grid");
+            continue;
+        }
+        ijk.insert(ijk.end(), Cells.begin() + c, Cells.begin() + c + 3);
+    }
+    if (WellId > 0) {
+        std::map<int, UTChemInputReader::WellData>::const_iterator it = deck->wellInfo.find(WellId);
+        if (it == deck->wellInfo.end()) {
+            vtkWarningMacro(<<"Well " << WellId << " is not defined in INPUT");
+        }
+        else {
+            const UTChemInputReader::WellData& well = it->second;
+            for (int w = well.ifirst; w <= well.ilast; ++w) {
+                int cell[3] = { well.iw, well.jw, w }; // parallel to z
+                if (well.idir == 1) {
+                    cell[0] = w; cell[1] = well.iw; cell[2] = well.jw;
+                }
+                else if (well.idir == 2) {
+                    cell[0] = well.iw; cell[1] = w; cell[2] = well.jw;
+                }
+                if (cell[0] >= 1 && cell[0] <= nx && cell[1] >= 1 && cell[1] <= ny && cell[2] >= 1 && cell[2] <= nz) {
+                    ijk.insert(ijk.end(), cell, cell + 3);
+                }
+            }
+        }
+    }
+
+    UTChemCellSeries series;
+    for (size_t c = 0; c < ijk.size(); c += 3) {
+        series.cells.push_back((ijk[c] - 1) + (vtkIdType) nx * (ijk[c + 1] - 1) + (vtkIdType) nx * ny * (ijk[c + 2] - 1));
+    }
+
+    if (series.cells.empty()) {
+        vtkWarningMacro(<<"No cells selected");
+        series.times = file->timeList;
+    }
+    else if (!file->readCellValues(series)) {
+        vtkErrorMacro(<<"Could not read the cells of " << FileName);
+        reader->Delete();
+        return 0;
+    }
+    reader->Delete();
+    this->UpdateProgress(0.9);
+
+    const vtkIdType rows = (vtkIdType) series.times.size();
+    const size_t cellCount = series.cells.size();
+
+    vtkDoubleArray* times = vtkDoubleArray::New();
+    times->SetName("Time");
+    times->SetNumberOfTuples(rows);
+    for (vtkIdType r = 0; r < rows; r++) {
+        times->SetValue(r, series.times[r]);
+    }
+    table->AddColumn(times);
+    times->Delete();
+
+    for (size_t a = 0; a < series.names.size(); a++) {
+        for (size_t c = 0; c < cellCount; c++) {
+            std::ostringstream name;
+            name << series.names[a] << " (" << ijk[3 * c] << "," << ijk[3 * c + 1] << "," << ijk[3 * c + 2] << ")";
+            vtkFloatArray* column = vtkFloatArray::New();
+            column->SetName(name.str().c_str());
+            column->SetNumberOfTuples(rows);
+            for (vtkIdType r = 0; r < rows; r++) {
+                column->SetValue(r, series.values[a][r * cellCount + c]);
+            }
+            table->AddColumn(column);
+            column->Delete();
+        }
+    }
+
+    this->UpdateProgress(1.0);
+    return 1;
+}
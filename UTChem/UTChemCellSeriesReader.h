@@ -0,0 +1,73 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemCellSeriesReader
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+// Time series of a few cells of a UTChem output file (SATP, CONCP...),
+// e.g. for plotting the saturation at a well against time. The output
+// table has a Time column and one column per array and cell, named
+// "ARRAY (i,j,k)". Only the layers that hold one of the cells are read,
+// the values of a layer are located without converting the others.
+
+#ifndef __UTChemCellSeriesReader_h
+#define __UTChemCellSeriesReader_h
+
+#include "vtkTableAlgorithm.h"
+
+#include <vector>
+
+class VTK_EXPORT UTChemCellSeriesReader : public vtkTableAlgorithm {
+public:
+    static UTChemCellSeriesReader* New();
+    vtkTypeMacro(UTChemCellSeriesReader, vtkTableAlgorithm);
+    virtual void PrintSelf(ostream& os, vtkIndent indent);
+
+    vtkSetStringMacro(FileName);
+    vtkGetStringMacro(FileName);
+
+    // Description:
+    // Cells to extract, 1-based (i,j,k) as in the INPUT deck.
+    void AddCell(int i, int j, int k);
+    void RemoveAllCells();
+    int GetNumberOfCells() { return (int) Cells.size() / 3; }
+
+    // Description:
+    // Also extract the cells completed by this well of the INPUT deck.
+    // 0 (the default) selects no well.
+    vtkSetClampMacro(WellId, int, 0, VTK_INT_MAX);
+    vtkGetMacro(WellId, int);
+
+protected:
+    UTChemCellSeriesReader();
+    virtual ~UTChemCellSeriesReader();
+
+    int RequestData(
+        vtkInformation* request,
+        vtkInformationVector** inputVector,
+        vtkInformationVector* outputVector);
+
+    char* FileName;
+    int WellId;
+
+private:
+    //BTX
+    UTChemCellSeriesReader(const UTChemCellSeriesReader&); // Not implemented.
+    void operator=(const UTChemCellSeriesReader&); // Not implemented.
+
+    std::vector<int> Cells; // i, j, k of each cell
+    //ETX
+};
+
+#endif // __UTChemCellSeriesReader_h
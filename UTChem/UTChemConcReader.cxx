@@ -20,10 +20,13 @@ PURPOSE.  See the above copyright notice for more information.
 #include <sstream>
 #include <fstream>
 #include <string>
+#include <cstring>
 #include <cassert>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
+#include <cmath>
 #include "vtkInformationVector.h"
 #include "vtkInformation.h"
 #include "vtkObjectFactory.h"
@@ -36,6 +39,9 @@ PURPOSE.  See the above copyright notice for more information.
 #include "vtkImageData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkRectilinearGrid.h"
+#include "vtkDataArraySelection.h"
+#include "vtkCallbackCommand.h"
+#include "vtkDoubleArray.h"
 
 #include <RVA_Util.h>
 
@@ -45,12 +51,312 @@ PURPOSE.  See the above copyright notice for more information.
 // --------------------------------------------------------
 vtkStandardNewMacro(UTChemConcReader);
 
-UTChemConcReader::UTChemConcReader()
+UTChemConcReader::UTChemConcReader() : ComputeStatistics(0), statisticsSteps(0), statisticsObj(NULL)
 {
+  this->SetNumberOfOutputPorts(2);
+  this->CellDataArraySelection = vtkDataArraySelection::New();
+  this->SelectionObserver = vtkCallbackCommand::New();
+  this->SelectionObserver->SetCallback(&UTChemConcReader::SelectionModifiedCallback);
+  this->SelectionObserver->SetClientData(this);
+  this->CellDataArraySelection->AddObserver(vtkCommand::ModifiedEvent, this->SelectionObserver);
 }
 
 UTChemConcReader::~UTChemConcReader()
 {
+  this->CellDataArraySelection->RemoveObserver(this->SelectionObserver);
+  this->SelectionObserver->Delete();
+  this->CellDataArraySelection->Delete();
+  if (this->statisticsObj) 
+  {
+    this->statisticsObj->Delete();
+  }
+}
+
+void UTChemConcReader::SetFileName(const char* name)
+{
+  if (name && this->FileName && !strcmp(name, this->FileName)) 
+  {
+    return;
+  }
+  this->Superclass::SetFileName(name);
+  clearStatistics();
+}
+
+// Called whenever the index is built again (e.g. a shorter file of a restarted
+// run), the accumulated steps may not exist any more
+void UTChemConcReader::freeDataVectors()
+{
+  this->Superclass::freeDataVectors();
+  clearStatistics();
+}
+
+// Decoded steps may lack arrays that are enabled now, so they are decoded again
+void UTChemConcReader::SelectionModifiedCallback(vtkObject*, unsigned long, void* clientdata, void*)
+{
+  UTChemConcReader* self = static_cast<UTChemConcReader*>(clientdata);
+  if (self->listArraysOnly) 
+  {
+    return; // collectArrayNames is adding arrays
+  }
+  self->flushStepCache();
+  self->clearStatistics(); // newly enabled arrays need all steps again
+  self->Modified();
+}
+
+int UTChemConcReader::RequestDataObject(vtkInformation* req, 
+                                        vtkInformationVector** inVect, 
+                                        vtkInformationVector* outVect)
+{
+  if (!this->Superclass::RequestDataObject(req, inVect, outVect)) 
+  {
+    return 0;
+  }
+  if (statisticsObj) 
+  {
+    statisticsObj->Delete();
+  }
+  statisticsObj = InputInfo->getObject(outVect->GetInformationObject(1));
+  if (!statisticsObj) 
+  {
+    return 0;
+  }
+  this->GetOutputPortInformation(1)->Set(vtkDataObject::DATA_EXTENT_TYPE(), statisticsObj->GetExtentType());
+  return 1;
+}
+
+int UTChemConcReader::RequestInformation(vtkInformation* request, 
+                                         vtkInformationVector** inputVector,
+                                         vtkInformationVector* outVec)
+{
+  if (!this->Superclass::RequestInformation(request, inputVector, outVec)) 
+  {
+    return 0;
+  }
+  int extent[6] = {0,nx,0,ny,0,nz};
+  outVec->GetInformationObject(1)->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent, 6);
+  return 1;
+}
+
+int UTChemConcReader::RequestData(vtkInformation* request, 
+                                  vtkInformationVector** inputVector,
+                                  vtkInformationVector* outVec)
+{
+  // Only output 1 may have been asked for, it does not depend on time
+  int ret = 1;
+  if (outVec->GetInformationObject(0)->Has(vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS())) 
+  {
+    ret = this->Superclass::RequestData(request, inputVector, outVec);
+  }
+  if (ret && ComputeStatistics) 
+  {
+    ret = buildStatisticsObject(outVec->GetInformationObject(1));
+  }
+  return ret;
+}
+
+// Streams every step that was not accumulated yet through accumulateStatistics. Steps
+// that were not resident are freed again right away, so only the accumulators stay.
+int UTChemConcReader::updateStatistics()
+{
+  stopPrefetch(); // restarted by the next RequestData
+  const unsigned steps = (unsigned) std::min(timeList.size(), allData.size());
+  for (unsigned i = statisticsSteps; i < steps; ++i) 
+  {
+    DecodeLock->Lock();
+    const bool resident = allData[i] != NULL;
+    if (!resident && !readTimeStep(i)) 
+    {
+      DecodeLock->Unlock();
+      vtkErrorMacro(<< "Failed to read time step index " << i)
+      return 0;
+    }
+    accumulateStatistics(i);
+    if (!resident) 
+    {
+      freeTimeStep(i);
+    }
+    DecodeLock->Unlock();
+    statisticsSteps = i + 1;
+    this->UpdateProgress((double) statisticsSteps / steps);
+  }
+  return 1;
+}
+
+// One Welford update per cell: the mean and the sum of squared deviations (m2) are
+// updated in place, which stays accurate where summing squares would cancel out
+void UTChemConcReader::accumulateStatistics(unsigned idx)
+{
+  const double t = timeList[idx];
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (IntegerTovtkFloatArrayMap_it it = allData[idx]->begin(); it != allData[idx]->end(); ++it) 
+  {
+    vtkFloatArray* array = (*it).second;
+    if (!array || !array->GetName() || array->GetNumberOfComponents() != 1) 
+    {
+      continue;
+    }
+    const size_t n = (size_t) array->GetNumberOfTuples();
+    TemporalStatistics& stats = statistics[array->GetName()];
+    if (stats.count.empty()) 
+    {
+      stats.min.assign(n, nan);
+      stats.max.assign(n, nan);
+      stats.mean.assign(n, 0.0);
+      stats.m2.assign(n, 0.0);
+      stats.timeOfMax.assign(n, nan);
+      stats.count.assign(n, 0);
+    }
+    if (stats.count.size() != n) 
+    {
+      continue;
+    }
+
+    const float* values = array->GetPointer(0);
+    for (size_t c = 0; c < n; ++c) 
+    {
+      const float x = values[c];
+      if (x != x) 
+      {
+        continue; // NaN, e.g. a layer the step did not contain
+      }
+      const int count = ++stats.count[c];
+      if (count == 1) 
+      {
+        stats.min[c] = stats.max[c] = x;
+        stats.timeOfMax[c] = t;
+      }
+      else if (x < stats.min[c]) 
+      {
+        stats.min[c] = x;
+      }
+      else if (x > stats.max[c]) 
+      {
+        stats.max[c] = x;
+        stats.timeOfMax[c] = t; // first time the maximum was reached
+      }
+      const double delta = x - stats.mean[c];
+      stats.mean[c] += delta / count;
+      stats.m2[c] += delta * (x - stats.mean[c]);
+    }
+  }
+}
+
+void UTChemConcReader::clearStatistics()
+{
+  statistics.clear();
+  statisticsSteps = 0;
+}
+
+// Geometry of the time dependent output and five arrays per array of the file:
+// NAME_Min, NAME_Max, NAME_Mean, NAME_StdDev (over all steps) and NAME_TimeOfMax
+int UTChemConcReader::buildStatisticsObject(vtkInformation* outInfo)
+{
+  vtkDataSet* dataSet = vtkDataSet::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+  if (!dataSet || !InputInfo || !updateStatistics()) 
+  {
+    return 0;
+  }
+
+  int ret = 0;
+  switch (InputInfo->getObjectType()) 
+  {
+    case 0:
+      ret = buildImageData(dataSet);
+      break;
+    case 1:
+      ret = buildRGridData(dataSet);
+      break;
+    case 2:
+      ret = buildSGridData(dataSet);
+      break;
+    default:
+      break;
+  }
+  if (!ret) 
+  {
+    return 0;
+  }
+
+  for (std::map<std::string, TemporalStatistics>::iterator it = statistics.begin(); it != statistics.end(); ++it) 
+  {
+    const TemporalStatistics& stats = it->second;
+    const vtkIdType n = (vtkIdType) stats.count.size();
+    vtkFloatArray* minimum = vtkFloatArray::New();
+    vtkFloatArray* maximum = vtkFloatArray::New();
+    vtkFloatArray* mean = vtkFloatArray::New();
+    vtkFloatArray* deviation = vtkFloatArray::New();
+    vtkDoubleArray* timeOfMax = vtkDoubleArray::New();
+    minimum->SetName((it->first + "_Min").c_str());
+    maximum->SetName((it->first + "_Max").c_str());
+    mean->SetName((it->first + "_Mean").c_str());
+    deviation->SetName((it->first + "_StdDev").c_str());
+    timeOfMax->SetName((it->first + "_TimeOfMax").c_str());
+    minimum->SetNumberOfTuples(n);
+    maximum->SetNumberOfTuples(n);
+    mean->SetNumberOfTuples(n);
+    deviation->SetNumberOfTuples(n);
+    timeOfMax->SetNumberOfTuples(n);
+
+    for (vtkIdType c = 0; c < n; ++c) 
+    {
+      const int count = stats.count[c];
+      minimum->SetValue(c, stats.min[c]);
+      maximum->SetValue(c, stats.max[c]);
+      mean->SetValue(c, count ? (float) stats.mean[c] : std::numeric_limits<float>::quiet_NaN());
+      deviation->SetValue(c, count ? (float) sqrt(stats.m2[c] / count) : std::numeric_limits<float>::quiet_NaN());
+      timeOfMax->SetValue(c, stats.timeOfMax[c]);
+    }
+
+    dataSet->GetCellData()->AddArray(minimum);
+    dataSet->GetCellData()->AddArray(maximum);
+    dataSet->GetCellData()->AddArray(mean);
+    dataSet->GetCellData()->AddArray(deviation);
+    dataSet->GetCellData()->AddArray(timeOfMax);
+    minimum->Delete();
+    maximum->Delete();
+    mean->Delete();
+    deviation->Delete();
+    timeOfMax->Delete();
+  }
+  return 1;
+}
+
+int UTChemConcReader::GetNumberOfCellArrays()
+{
+  return this->CellDataArraySelection->GetNumberOfArrays();
+}
+
+const char* UTChemConcReader::GetCellArrayName(int index)
+{
+  return this->CellDataArraySelection->GetArrayName(index);
+}
+
+int UTChemConcReader::GetCellArrayStatus(const char* name)
+{
+  return this->CellDataArraySelection->ArrayIsEnabled(name);
+}
+
+void UTChemConcReader::SetCellArrayStatus(const char* name, int status)
+{
+  if (status) 
+  {
+    this->CellDataArraySelection->EnableArray(name);
+  }
+  else 
+  {
+    this->CellDataArraySelection->DisableArray(name);
+  }
+}
+
+void UTChemConcReader::addArrayName(const std::string& name)
+{
+  this->CellDataArraySelection->AddArray(name.c_str()); // keeps the status of known arrays
+}
+
+// Arrays that were not seen by the pre-scan are read
+int UTChemConcReader::isArrayEnabled(const char* name)
+{
+  return !this->CellDataArraySelection->ArrayExists(name) || this->CellDataArraySelection->ArrayIsEnabled(name);
 }
 
 // MVM: is this necessary, isn't this handled by the servermanager xml?
@@ -101,8 +407,7 @@ void UTChemConcReader::readHeader()
   //USING UTCHEM 9.0
   std::string oneLine;
   for(int i = 0; i < 5 ; ++i) { // Naive approach - should be on 5th line
-    std::getline(stream, oneLine);
-    line_num++;
+    oneLine = readNextLine(false);
   }
   nx = ny = nz = -1;
   int read = sscanf(oneLine.c_str(), "  NX =           %d  NY =           %d  NZ =            %d", &nx, &ny, &nz);
@@ -116,22 +421,33 @@ void UTChemConcReader::readHeader()
 
 }
 
-/* Returns 1 if line was eaten, 0 otherwise. Does not but could throw an std:ex if we choke on the line */
-int UTChemConcReader::parseAsATIMEline(const char* c_str)
+/* Returns 1 and sets t if this line starts a new time step. Used by both the pre-scan and readTimeStep */
+int UTChemConcReader::isTimeStepLine(const char* c_str, double& t)
 {
-  if( 2 != sscanf(c_str, "TIME = %lg DAYS PORE VOLUMES INJ. =  %f", &time, &inj))
-    return 0; // Failed
-  timestep++;
-  this->currentTimeStep = new IntegerTovtkFloatArrayMap();
-  allData.push_back(this->currentTimeStep);
-  timeList.push_back(time);
-
-  double filePosition = (double)stream.tellg();
-  if(filePosition>0 && fileLength>0)
-    this->UpdateProgress( filePosition / fileLength);
-
+  if( 2 != sscanf(c_str, "TIME = %lg DAYS PORE VOLUMES INJ. =  %f", &t, &inj))
+    return 0; // Not a TIME line
   return 1;
 }
+
+// Time values of the steps in fileName (e.g. for UTChemFluxReader). An existing
+// sidecar index is used, but none is written for a file that was not opened itself.
+bool UTChemConcReader::readTimeSteps(const char* fileName, std::vector<double>& times)
+{
+  times.clear();
+  UTChemConcReader* reader = UTChemConcReader::New();
+  reader->CacheDecodedArrays = 0; // only the index is needed
+  reader->sidecarReadOnly = true;
+  if (reader->CanReadFile(fileName)) 
+  {
+    reader->SetFileName(fileName);
+    if (reader->buildTimeStepIndex()) 
+    {
+      times = reader->timeList;
+    }
+  }
+  reader->Delete();
+  return !times.empty();
+}
 /* Returns 1 if line was eaten, 0 otherwise. Does not but could throw an std:ex if we choke on the line */
 int UTChemConcReader::parseAsASATPHASEline(const char* c_str)
 {
@@ -152,7 +468,7 @@ int UTChemConcReader::parseAsAStandardPropertyline(const char* c_str)
     return 0;
   measure[sizeof(measure)-1] = unit[sizeof(unit)-1]='\0'; // paranoia for too large strings
   if(strlen(unit) <2 || unit[0] != '(' || unit[strlen(unit)-1] != ')') {
-    vtkErrorMacro(<<"Expected to find (unit) but got '"<<unit<<"'")
+    vtkDecodeErrorMacro(<<"Expected to find (unit) but got '"<<unit<<"'")
   }
   return readLayerValues();
 }
@@ -214,7 +530,7 @@ int UTChemConcReader::parseAsACONCENTRATIONline(const char* c_str)
       name += (* (++c_str));
     } while (c_str < inLayer_str);
 
-    vtkDebugMacro(<<"Extracted name:'"<< name<<"' for component "<<phase)
+    vtkDecodeDebugMacro(<<"Extracted name:'"<< name<<"' for component "<<phase)
     componentNames[phase] = name;
   }
 
@@ -257,7 +573,7 @@ int UTChemConcReader::parseAsPCONCENTRATIONline(const char* match, const char* c
 
   // Since there are possible collisions, we need to use the reverse map
   if(reverseMap.count(name)  == 0) {
-    vtkDebugMacro(<<"Extracted name:'"<< name<<"' for component "<<phase)
+    vtkDecodeDebugMacro(<<"Extracted name:'"<< name<<"' for component "<<phase)
     reverseMap[name] = reverseMap.size();
   }
 
@@ -280,9 +596,6 @@ int UTChemConcReader::parseAsTEMPERATUREline(const char* c_str)
 
 int UTChemConcReader::parseAsPERMEABILITYline(const char* c_str)
 {
-  // Simulate time to get a valid array
-  if(this->currentTimeStep == NULL)
-    parseAsATIMEline("TIME = 0.0 DAYS PORE VOLUMES INJ. =  0.0"); // Hack to read in timeless data
   // X-PERMEABILITY (MD) IN LAYER            1
   if(1 != sscanf(c_str,"X-PERMEABILITY (%*c%*c) IN LAYER  %d",&layer))
     return 0;
@@ -293,9 +606,6 @@ int UTChemConcReader::parseAsPERMEABILITYline(const char* c_str)
 
 int UTChemConcReader::parseAsPOROSITYline(const char* c_str)
 {
-  // Simulate time to get a valid array
-  if(this->currentTimeStep == NULL)
-    parseAsATIMEline("TIME = 0.0 DAYS PORE VOLUMES INJ. =  0.0"); // Hack to read in timeless data
   // POROSITY IN LAYER            1
   if(1 != sscanf(c_str,"POROSITY IN LAYER  %d",&layer))
     return 0;
@@ -323,10 +633,8 @@ int UTChemConcReader::parseAsSURFACTANTline(const char* c_str)
 // Reads a UTChem data file (.CONC / .VISC etc )
 int UTChemConcReader::parseLine(const char* c_str) {
 	std::string line(c_str);
-	if (line.find("TIME") == 0) {
-		return parseAsATIMEline(c_str);
-	}
-	else if (line.find("SAT. OF PHASE") == 0) {
+	// TIME lines are handled by UTChemAsciiReader::readTimeStep
+	if (line.find("SAT. OF PHASE") == 0) {
         return parseAsASATPHASEline(c_str);
 	}
     else if (line.find("PRESSURE") == 0 || line.find("VISCOSITY") == 0) {
@@ -24,9 +24,12 @@ PURPOSE.  See the above copyright notice for more information.
 
 #include <vector>
 #include <map>
+#include <string>
 #include <utility>
 #include <fstream>
 
+class vtkDataArraySelection;
+class vtkCallbackCommand;
 
 class VTK_EXPORT UTChemConcReader : public UTChemAsciiReader {
 public:
@@ -35,18 +38,75 @@ public:
 
   virtual int CanReadFile(const char*);
 
+  // Description:
+  // Another file starts the statistics over.
+  virtual void SetFileName(const char* name);
+
+  // Description:
+  // Cell array selection, filled from the block headers of the file.
+  // Blocks of disabled arrays are skipped without decoding their values.
+  int GetNumberOfCellArrays();
+  const char* GetCellArrayName(int index);
+  int GetCellArrayStatus(const char* name);
+  void SetCellArrayStatus(const char* name, int status);
+
+  // Description:
+  // Fill the second output with statistics over all time steps of each
+  // enabled array: per cell minimum, maximum, mean, standard deviation
+  // and the time of the maximum. The steps are decoded one at a time and
+  // only the running sums are kept, so later updates (and new steps in
+  // follow mode) cost next to nothing. Off by default.
+  vtkSetMacro(ComputeStatistics, int);
+  vtkGetMacro(ComputeStatistics, int);
+  vtkBooleanMacro(ComputeStatistics, int);
+
+  //BTX
+  // Time values of the steps in fileName, using its sidecar index if there is one
+  static bool readTimeSteps(const char* fileName, std::vector<double>& times);
+  //ETX
+
 protected:
   UTChemConcReader();
   ~UTChemConcReader();
+
+  // Output 1 holds the statistics, it has no time steps
+  virtual int RequestDataObject(vtkInformation*, vtkInformationVector**, vtkInformationVector*);
+  virtual int RequestInformation(vtkInformation*, vtkInformationVector**, vtkInformationVector*);
+  virtual int RequestData(vtkInformation*, vtkInformationVector**, vtkInformationVector*);
+
+  vtkDataArraySelection* CellDataArraySelection;
+  vtkCallbackCommand* SelectionObserver;
+  int ComputeStatistics;
+
+  static void SelectionModifiedCallback(vtkObject* caller, unsigned long eid, void* clientdata, void* calldata);
+  virtual void freeDataVectors(); // also drops the statistics, the index is rebuilt
   
 private:
   //BTX
+  // Welford accumulators of one array, per cell. NaN values are not counted.
+  struct TemporalStatistics
+  {
+    std::vector<float> min, max;
+    std::vector<double> mean, m2, timeOfMax;
+    std::vector<int> count;
+  };
+  std::map<std::string, TemporalStatistics> statistics;
+  unsigned statisticsSteps; // time steps accumulated so far
+  vtkDataObject* statisticsObj;
+
+  int updateStatistics(); // accumulates the steps indexed since the last call, 0 if failed
+  void accumulateStatistics(unsigned idx);
+  void clearStatistics();
+  int buildStatisticsObject(vtkInformation* outInfo);
+
+  void addArrayName(const std::string& name);
+  int isArrayEnabled(const char* name);
 
 // internal functions for readFile
   void readHeader(); // throws exception if invalid nx,ny,nz
   int parseLine(const char* c_str);
 
-  int parseAsATIMEline(const char* c_str); // 1 for success
+  int isTimeStepLine(const char* c_str, double& t); // 1 for success
   int parseAsAStandardPropertyline(const char* c_str);
   int parseAsACONCENTRATIONline(const char* c_str);
   int parseAsASATPHASEline(const char* c_str);
@@ -17,7 +17,10 @@ PURPOSE.  See the above copyright notice for more information.
 
 #include "UTChemFluxReader.h"
 #include "UTChemInputReader.h"
+#include "UTChemScanner.h"
+#include "UTChemConcReader.h"
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -47,7 +50,7 @@ PURPOSE.  See the above copyright notice for more information.
 // --------------------------------------------------------
 vtkStandardNewMacro(UTChemFluxReader);
 
-UTChemFluxReader::UTChemFluxReader() : fluxNameCount(0),directionXYZ(0)
+UTChemFluxReader::UTChemFluxReader() : UseConcTimes(1), fluxNameCount(0),directionXYZ(0), layerOffset(-1)
 {
 }
 
@@ -86,6 +89,92 @@ const char* UTChemFluxReader::fileExtensionToLabel(std::string&ext) {
 	return "";
 }
 
+int UTChemFluxReader::buildTimeStepIndex() {
+	if (!UTChemAsciiReader::buildTimeStepIndex()) {
+		return 0;
+	}
+	if (UseConcTimes && !FollowFile) {
+		applyConcTimes();
+	}
+	return 1;
+}
+
+// getCurrentFloatArray used to start a new step whenever the X flux of the first phase
+// appeared in layer 1; the pre-scan records the offsets of exactly those places.
+void UTChemFluxReader::indexLine(const char* c_str, std::streamoff offset) {
+	if (contains(c_str,"D E T A I L S   O F   L A Y E R   N U M B E R")) {
+		parseAsLayerIdent(c_str);
+		layerOffset = (layer == 0) ? offset : -1;
+		return;
+	}
+	if (layer != 0 || !contains(c_str,"PHASE X-FLUX")) {
+		return;
+	}
+	char name[100];
+	if (1 != sscanf(c_str, "%99s", name)) {
+		return;
+	}
+	if (firstFluxName.empty()) {
+		firstFluxName = name;
+	}
+	if (firstFluxName == name) {
+		TimeStepEntry entry;
+		entry.time = (double) stepIndex.size();
+		entry.offset = layerOffset >= 0 ? layerOffset : offset;
+		stepIndex.push_back(entry);
+		layerOffset = -1;
+	}
+}
+
+// Steps have no blocks, but all are written with the same layout and thus the same size
+void UTChemFluxReader::dropIncompleteLastStep() {
+	if (!FollowFile || stepIndex.size() < 2) {
+		return;
+	}
+	std::streamoff last = stepIndex.back().offset;
+	std::streamoff previous = stepIndex[stepIndex.size()-2].offset;
+	// compare without the blank lines that separate the steps
+	const char* previousEnd = mappedFile.begin() + last;
+	while (previousEnd > mappedFile.begin() + previous && scanIsSpace(previousEnd[-1])) {
+		previousEnd--;
+	}
+	const char* lastEnd = mappedFile.end();
+	while (lastEnd > mappedFile.begin() + last && scanIsSpace(lastEnd[-1])) {
+		lastEnd--;
+	}
+	bool complete = lastEnd - (mappedFile.begin() + last) >= previousEnd - (mappedFile.begin() + previous)
+		&& mappedFile.end()[-1] == '\n';
+	if (!complete) {
+		vtkDebugMacro(<<"Time step "<<stepIndex.size()-1<<" is still being written")
+		unfinishedStep = last;
+		stepIndex.pop_back();
+	}
+}
+
+// Replaces the step numbers by the times of RUN.CONCP when it has as many steps
+void UTChemFluxReader::applyConcTimes() {
+	std::string concFile(FileName);
+	size_t dot = concFile.rfind('.');
+	if (dot == std::string::npos) {
+		return;
+	}
+	concFile.replace(dot+1, std::string::npos, "CONCP");
+
+	std::vector<double> times;
+	if (!UTChemConcReader::readTimeSteps(concFile.c_str(), times)) {
+		vtkDebugMacro(<<"No times found in "<<concFile)
+		return;
+	}
+	if (times.size() != stepIndex.size()) {
+		vtkWarningMacro(<<concFile<<" has "<<times.size()<<" time steps but "<<FileName<<" has "<<stepIndex.size()<<", using step numbers as time")
+		return;
+	}
+	for (unsigned i = 0; i < stepIndex.size(); ++i) {
+		stepIndex[i].time = times[i];
+	}
+	timeList = times;
+}
+
 /* throws an exception if nx,ny,nz if valid dimensions could not be extracted from header */
 void UTChemFluxReader::readHeader()
 {
@@ -97,6 +186,8 @@ void UTChemFluxReader::readHeader()
     directionXYZ=-1; //0,1,2
     fluxNameCount=0;
     fluxNameToIndex.clear();
+    firstFluxName.clear();
+    layerOffset = -1;
 }
 
 // Reads a UTChem data file (.CONC / .VISC etc )
@@ -131,7 +222,7 @@ int UTChemFluxReader::parseAsFluxHeader(const char* c_str){
 	char directionChar;
 
 	if( 3!=sscanf(c_str,"%99s PHASE %c-FLUX  (%255s",this->phaseName,&directionChar,fluxUnits)) {
-		vtkErrorMacro(<<"Could not parse PHASE FLUX :'"<<nextLine<<"'")
+		vtkDecodeErrorMacro(<<"Could not parse PHASE FLUX :'"<<nextLine<<"'")
 			throw std::runtime_error("Failed to read phase flux heading");
 
 	}
@@ -143,7 +234,7 @@ int UTChemFluxReader::parseAsFluxHeader(const char* c_str){
 	// MVM: is this really doing char arithmetic?!
 	this->directionXYZ = directionChar-'X';
 	if(!*phaseName || !*fluxUnits || directionXYZ<0 || directionXYZ>2) {
-		vtkErrorMacro(<<"Unexpected PHASE FLUX values :'"<<nextLine<<"'")
+		vtkDecodeErrorMacro(<<"Unexpected PHASE FLUX values :'"<<nextLine<<"'")
 		throw std::runtime_error("Unexpected values found in phase flux heading");
 	}
 	std::string phaseNameString(phaseName);
@@ -157,83 +248,74 @@ int UTChemFluxReader::parseAsFluxHeader(const char* c_str){
 	return 1;
 }
 
+// Decodes the J/I= column blocks of one layer straight out of the mapped file.
+// Each block has a header row with the I indices of its columns, followed by
+// ny rows that start with the J index.
 int UTChemFluxReader::readFluxDataTable() { // 1 for success
-	std::stringstream ss;
-	
 	vtkFloatArray* array = getCurrentFloatArray();
 
-	int numColsParsedEarlier = 0;
+	if (!array || directionXYZ < 0 || directionXYZ >= (int)array->GetNumberOfComponents()) {
+		throw std::runtime_error("Invalid internal state");
+	}
+	const int components = array->GetNumberOfComponents();
+	const vtkIdType tuples = array->GetNumberOfTuples();
+	float* values = array->GetPointer(0) + directionXYZ;
 
-	// What about reading this number of values directly?
+	int numColsParsedEarlier = 0;
 	size_t remainNumValues = nx * ny;
 	while (numColsParsedEarlier < nx) {
 
-		std::vector<int> indices;
-		const char* c_str = readNextLine(true); 
-		ss.str(c_str);
-		std::string str;
-		ss >> str;
-		if (str != "J/I=") {
-			std::cerr << "Not a table header row: " << str << std::endl;
+		const char* lineEnd;
+		const char* p = readNextRawLine(lineEnd, true);
+		p = scanSkipSpace(p, lineEnd);
+		const char* token = scanSkipToken(p, lineEnd);
+		if (token - p != 4 || strncmp(p, "J/I=", 4) != 0) {
+			vtkDecodeErrorMacro(<<"Not a table header row: "<<std::string(p, token))
 		}
+		// Only the number of column indices matters, they are consecutive
+		int numColsExpected = 0;
 		int column;
-		while (ss >> column) {
-			indices.push_back(column);
+		bool isNumber;
+		for (p = scanInt(token, lineEnd, column, isNumber); isNumber; p = scanInt(p, lineEnd, column, isNumber)) {
+			numColsExpected++;
+		}
+		if (numColsExpected < 1) {
+			throw std::runtime_error("Expected at least one data column");
+		}
+		if (numColsParsedEarlier + numColsExpected > nx) {
+			throw std::runtime_error("Incorrect number of columns in J/I data");
 		}
-		ss.clear();
-		
-	    // MVM: naming - why would one expect 0 columns?	
-		int numColsExpected = 0;
 
-		// MVM: read ny rows of actual data.
 		for (int j = 0; j < ny; j++) {
+			p = readNextRawLine(lineEnd, true);
 
-			// MVM: read first line of data
-			c_str = readNextLine(true);
-			ss.str(c_str);
-		
-		    // MVM: first col contains the J index	
+			// first col contains the J index
 			int jthIndex;
-			ss >> jthIndex;
-
-			if (jthIndex < 1 || jthIndex > ny || jthIndex != j+1) {
+			p = scanInt(p, lineEnd, jthIndex, isNumber);
+			if (!isNumber || jthIndex < 1 || jthIndex > ny || jthIndex != j+1) {
 				throw std::runtime_error("Invalid j index");
 			}
 
 			vtkIdType idx = this->layer*nx*ny + j*nx + numColsParsedEarlier;
-
-			// sanity check: paranoia because SetComponent performs no bounds checking
-			if ( !array || idx < 0 
-				|| (long)idx + (nx-numColsParsedEarlier) > (long)array->GetNumberOfTuples() 
-				|| directionXYZ < 0 || directionXYZ >= (int)array->GetNumberOfComponents())
-			{
+			if (idx < 0 || idx + numColsExpected > tuples) {
 				throw std::runtime_error("Invalid internal state");
 			}
-		
-			std::vector<int>::const_iterator it;
-			int columnCount = 0;
-			float f;
-			for (it = indices.begin(); it != indices.end(); ++it) {
-				ss >> f;
-				array->SetComponent(idx, directionXYZ, f);
-				columnCount++;
-				remainNumValues--;
-				idx++;
-			}
-			ss.clear();
 
-			// sanity check that all remaining rows also have a reasonable column count - 
-			if (j == 0) {
-				numColsExpected = columnCount;
-				if (columnCount < 1) {
-					throw std::runtime_error("Expected at least one data column");
+			float* out = values + idx * components;
+			int columnCount = 0;
+			for (p = scanSkipSpace(p, lineEnd); p < lineEnd; p = scanSkipSpace(p, lineEnd)) {
+				if (columnCount == numColsExpected) {
+					throw std::runtime_error("Incorrect number of columns in J/I data");
 				}
+				p = scanFloat(p, lineEnd, *out, isNumber);
+				out += components;
+				columnCount++;
 			}
-			else if (columnCount != numColsExpected) {
+			if (columnCount != numColsExpected) {
 				throw std::runtime_error("Incorrect number of columns in J/I data");
 			}
+			remainNumValues -= columnCount;
 		} // for all rows of data
-		indices.clear();
 		numColsParsedEarlier += numColsExpected;
 	} // while
 	if (remainNumValues != 0) {
@@ -246,15 +328,7 @@ vtkFloatArray* UTChemFluxReader::getCurrentFloatArray() {
 	assert(nx>0 && ny >0 && nz>0);
 	assert(layer>=0 && layer<nz);
 // PROF files do not include a timestep info for the flux data!
-// So we assume that if we see the same phasename/flux/layer that it's the next time step
-// Assume files always write X,Y,Z order
-  bool startNextTimeStep = phase==1 && layer ==0 && directionXYZ ==0;  
-  if(startNextTimeStep) {
-	  time = timestep++;
-	  this->currentTimeStep = new IntegerTovtkFloatArrayMap();
-	  allData.push_back(this->currentTimeStep);
-	  timeList.push_back(time);
-  }
+// The steps are found by indexLine, readTimeStep sets up currentTimeStep
 
   unsigned arraySize = nx*ny*nz;
 
@@ -35,14 +35,31 @@ public:
 
   virtual int CanReadFile(const char*);
 
+  // Description:
+  // PROF files carry no times. If on (the default) the times of the steps
+  // are taken from the CONCP file of the same run, provided it holds the
+  // same number of steps; otherwise the steps are numbered 0,1,2...
+  // Not used in follow mode.
+  vtkSetMacro(UseConcTimes, int);
+  vtkGetMacro(UseConcTimes, int);
+  vtkBooleanMacro(UseConcTimes, int);
+
 protected:
   UTChemFluxReader();
   ~UTChemFluxReader();
+
+  int UseConcTimes;
   
 private:
   //BTX
   virtual const char*fileExtensionToLabel(std::string&ext);
 
+  // PROF files carry no TIME markers, steps are found from the layer and flux headings
+  virtual int buildTimeStepIndex();
+  virtual void indexLine(const char* c_str, std::streamoff offset);
+  virtual void dropIncompleteLastStep();
+  void applyConcTimes();
+
 // internal functions for readFile and parseLine
   virtual void readHeader(); //  throws exception if invalid nx,ny,nz
   virtual int parseLine(const char* c_str);
@@ -58,6 +75,10 @@ private:
   int fluxNameCount;
   std::map<std::string,int> fluxNameToIndex;
 
+  // pre-scan state
+  std::string firstFluxName; // the flux that starts every time step
+  std::streamoff layerOffset; // heading of layer 1 not yet assigned to a step, -1 if none
+
   //ETX
 };
 
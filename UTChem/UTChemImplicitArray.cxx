@@ -0,0 +1,310 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemImplicitArray
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "UTChemImplicitArray.h"
+
+#include "vtkFloatArray.h"
+#include "vtkIdList.h"
+#include "vtkObjectFactory.h"
+#include "vtkVariant.h"
+
+// --------------------------------------------------------
+UTChemImplicitArray::UTChemImplicitArray() : Materialized(NULL)
+{
+  this->Tuple[0] = this->Tuple[1] = this->Tuple[2] = 0.0;
+}
+
+UTChemImplicitArray::~UTChemImplicitArray()
+{
+  if (this->Materialized) {
+    this->Materialized->Delete();
+  }
+}
+
+void UTChemImplicitArray::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Materialized: " << (this->Materialized ? "yes" : "no") << "\n";
+}
+
+// New arrays of "the same type" are meant to be filled, so they are plain float arrays
+vtkObjectBase* UTChemImplicitArray::NewInstanceInternal() const
+{
+  return vtkFloatArray::New();
+}
+
+void UTChemImplicitArray::SetShape(vtkIdType tuples, int components)
+{
+  this->NumberOfComponents = components;
+  this->Size = tuples * components;
+  this->MaxId = this->Size - 1;
+  this->Modified(); // releases Materialized
+}
+
+void UTChemImplicitArray::ReadOnly(const char* method)
+{
+  vtkErrorMacro(<< method << ": " << this->GetClassName() << " is read only");
+}
+
+double* UTChemImplicitArray::GetTuple(vtkIdType i)
+{
+  this->ComputeTuple(i, this->Tuple);
+  return this->Tuple;
+}
+
+void UTChemImplicitArray::GetTuple(vtkIdType i, double* tuple)
+{
+  this->ComputeTuple(i, tuple);
+}
+
+// vtkDataArray allocates a tuple on the heap for every call
+double UTChemImplicitArray::GetComponent(vtkIdType i, int j)
+{
+  double tuple[3];
+  this->ComputeTuple(i, tuple);
+  return tuple[j];
+}
+
+double UTChemImplicitArray::GetTuple1(vtkIdType i)
+{
+  double tuple[3];
+  this->ComputeTuple(i, tuple);
+  return tuple[0];
+}
+
+vtkFloatArray* UTChemImplicitArray::GetMaterialized()
+{
+  if (!this->Materialized) {
+    const vtkIdType tuples = this->GetNumberOfTuples();
+    const int components = this->NumberOfComponents;
+    this->Materialized = vtkFloatArray::New();
+    this->Materialized->SetName(this->GetName());
+    this->Materialized->SetNumberOfComponents(components);
+    this->Materialized->SetNumberOfTuples(tuples);
+    float* out = this->Materialized->GetPointer(0);
+    double tuple[3];
+    for (vtkIdType i = 0; i < tuples; ++i) {
+      this->ComputeTuple(i, tuple);
+      for (int c = 0; c < components; ++c) {
+        *out++ = static_cast<float>(tuple[c]);
+      }
+    }
+  }
+  return this->Materialized;
+}
+
+// Only for consumers that insist on raw memory, everything else computes values on access
+void* UTChemImplicitArray::GetVoidPointer(vtkIdType id)
+{
+  return this->GetMaterialized()->GetVoidPointer(id);
+}
+
+vtkArrayIterator* UTChemImplicitArray::NewIterator()
+{
+  return this->GetMaterialized()->NewIterator();
+}
+
+vtkIdType UTChemImplicitArray::LookupValue(vtkVariant value)
+{
+  const double wanted = value.ToDouble();
+  const vtkIdType values = this->MaxId + 1;
+  for (vtkIdType i = 0; i < values; ++i) {
+    if (this->GetComponent(i / this->NumberOfComponents, i % this->NumberOfComponents) == wanted) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void UTChemImplicitArray::LookupValue(vtkVariant value, vtkIdList* ids)
+{
+  ids->Reset();
+  const double wanted = value.ToDouble();
+  const vtkIdType values = this->MaxId + 1;
+  for (vtkIdType i = 0; i < values; ++i) {
+    if (this->GetComponent(i / this->NumberOfComponents, i % this->NumberOfComponents) == wanted) {
+      ids->InsertNextId(i);
+    }
+  }
+}
+
+unsigned long UTChemImplicitArray::GetActualMemorySize()
+{
+  unsigned long size = 1;
+  if (this->Materialized) {
+    size += this->Materialized->GetActualMemorySize();
+  }
+  return size;
+}
+
+void UTChemImplicitArray::DataChanged()
+{
+  if (this->Materialized) {
+    this->Materialized->Delete();
+    this->Materialized = NULL;
+  }
+}
+
+// Consumers that still need raw memory afterwards ask for it again
+void UTChemImplicitArray::Modified()
+{
+  this->DataChanged();
+  this->Superclass::Modified();
+}
+
+void UTChemImplicitArray::Initialize()
+{
+  this->SetShape(0, this->NumberOfComponents);
+}
+
+int UTChemImplicitArray::Allocate(vtkIdType, vtkIdType)
+{
+  this->ReadOnly("Allocate");
+  return 0;
+}
+
+void UTChemImplicitArray::SetNumberOfTuples(vtkIdType)
+{
+  this->ReadOnly("SetNumberOfTuples");
+}
+
+int UTChemImplicitArray::Resize(vtkIdType)
+{
+  this->ReadOnly("Resize");
+  return 0;
+}
+
+void UTChemImplicitArray::SetVoidArray(void*, vtkIdType, int)
+{
+  this->ReadOnly("SetVoidArray");
+}
+
+void* UTChemImplicitArray::WriteVoidPointer(vtkIdType, vtkIdType)
+{
+  this->ReadOnly("WriteVoidPointer");
+  return NULL;
+}
+
+void UTChemImplicitArray::SetTuple(vtkIdType, const float*)
+{
+  this->ReadOnly("SetTuple");
+}
+
+void UTChemImplicitArray::SetTuple(vtkIdType, const double*)
+{
+  this->ReadOnly("SetTuple");
+}
+
+void UTChemImplicitArray::InsertTuple(vtkIdType, const float*)
+{
+  this->ReadOnly("InsertTuple");
+}
+
+void UTChemImplicitArray::InsertTuple(vtkIdType, const double*)
+{
+  this->ReadOnly("InsertTuple");
+}
+
+vtkIdType UTChemImplicitArray::InsertNextTuple(const float*)
+{
+  this->ReadOnly("InsertNextTuple");
+  return -1;
+}
+
+vtkIdType UTChemImplicitArray::InsertNextTuple(const double*)
+{
+  this->ReadOnly("InsertNextTuple");
+  return -1;
+}
+
+void UTChemImplicitArray::InsertVariantValue(vtkIdType, vtkVariant)
+{
+  this->ReadOnly("InsertVariantValue");
+}
+
+void UTChemImplicitArray::RemoveTuple(vtkIdType)
+{
+  this->ReadOnly("RemoveTuple");
+}
+
+void UTChemImplicitArray::RemoveFirstTuple()
+{
+  this->ReadOnly("RemoveFirstTuple");
+}
+
+void UTChemImplicitArray::RemoveLastTuple()
+{
+  this->ReadOnly("RemoveLastTuple");
+}
+
+// --------------------------------------------------------
+vtkStandardNewMacro(UTChemConstantArray);
+
+void UTChemConstantArray::SetConstant(double value, vtkIdType tuples)
+{
+  this->Value = value;
+  this->SetShape(tuples, 1);
+}
+
+void UTChemConstantArray::ComputeTuple(vtkIdType, double* tuple)
+{
+  tuple[0] = this->Value;
+}
+
+// --------------------------------------------------------
+vtkStandardNewMacro(UTChemSeparableArray);
+
+void UTChemSeparableArray::SetFactors(int nx, int nz, const std::vector<double>& section, const std::vector<double>& y)
+{
+  this->NX = nx;
+  this->NZ = nz;
+  this->Section = section;
+  this->Y = y;
+  this->SetShape((vtkIdType) nx * (vtkIdType) y.size() * nz, 1);
+}
+
+void UTChemSeparableArray::ComputeTuple(vtkIdType i, double* tuple)
+{
+  const vtkIdType ny = (vtkIdType) this->Y.size();
+  const vtkIdType x = i % this->NX;
+  const vtkIdType j = (i / this->NX) % ny;
+  const vtkIdType k = i / (this->NX * ny);
+  tuple[0] = this->Section[x + k * this->NX] * this->Y[j];
+}
+
+// --------------------------------------------------------
+vtkStandardNewMacro(UTChemExtrudedPointArray);
+
+void UTChemExtrudedPointArray::SetSection(int nx, int nz, const std::vector<double>& x, const std::vector<double>& depth, const std::vector<double>& y)
+{
+  this->NX = nx;
+  this->NZ = nz;
+  this->X = x;
+  this->Depth = depth;
+  this->Y = y;
+  this->SetShape((vtkIdType) (nx + 1) * (vtkIdType) y.size() * (nz + 1), 3);
+}
+
+void UTChemExtrudedPointArray::ComputeTuple(vtkIdType i, double* tuple)
+{
+  const vtkIdType px = this->NX + 1;
+  const vtkIdType py = (vtkIdType) this->Y.size();
+  const vtkIdType node = i % px + (i / (px * py)) * px; // node of the section
+  tuple[0] = this->X[node];
+  tuple[1] = this->Y[(i / px) % py];
+  tuple[2] = -this->Depth[node];
+}
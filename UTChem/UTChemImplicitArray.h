@@ -0,0 +1,191 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemImplicitArray
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __UTChemImplicitArray_h
+#define __UTChemImplicitArray_h
+
+#include <cstring>
+#include <vector>
+
+#include "vtkDataArray.h"
+#include "vtkFloatArray.h"
+
+// Read only arrays whose values are computed on access from a few small
+// vectors of the INPUT deck, for data that a regular grid already implies
+// (cell volumes, points of an extruded section). They report VTK_FLOAT like
+// the arrays they replace.
+//
+// Consumers that ask for raw memory (GetVoidPointer) get a float copy that
+// is built on first use. There is no telling when they are done with the
+// pointer, so the copy is kept until the array is modified or its shape
+// changes; for the deck's arrays, shared by all readers, that can be the
+// lifetime of the deck. GetActualMemorySize includes the copy.
+// NewInstance gives a plain vtkFloatArray, so filters that copy tuples into
+// a new array of the same type get a writable one.
+//
+// Like vtkDataArray, GetTuple(i) returns a member tuple, and so does
+// GetTuple1 when it is called through a vtkDataArray pointer; values may
+// only be read by one thread at a time.
+
+// vtkAbstractTypeMacro, except that NewInstance returns the vtkFloatArray
+// of NewInstanceInternal instead of down casting it to thisClass (NULL)
+#define UTChemImplicitArrayTypeMacro(thisClass,superclass) \
+  protected: \
+  virtual const char* GetClassNameInternal() const { return #thisClass; } \
+  public: \
+  typedef superclass Superclass; \
+  static int IsTypeOf(const char* type) \
+  { \
+    if (!strcmp(#thisClass, type)) { \
+      return 1; \
+    } \
+    return superclass::IsTypeOf(type); \
+  } \
+  virtual int IsA(const char* type) \
+  { \
+    return this->thisClass::IsTypeOf(type); \
+  } \
+  static thisClass* SafeDownCast(vtkObjectBase* o) \
+  { \
+    if (o && o->IsA(#thisClass)) { \
+      return static_cast<thisClass*>(o); \
+    } \
+    return NULL; \
+  } \
+  vtkFloatArray* NewInstance() const \
+  { \
+    return vtkFloatArray::SafeDownCast(this->NewInstanceInternal()); \
+  }
+
+class UTChemImplicitArray : public vtkDataArray
+{
+public:
+  UTChemImplicitArrayTypeMacro(UTChemImplicitArray, vtkDataArray);
+  virtual void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Value of tuple i, NumberOfComponents doubles
+  virtual void ComputeTuple(vtkIdType i, double* tuple) = 0;
+
+  // vtkDataArray interface, values come from ComputeTuple
+  virtual double* GetTuple(vtkIdType i);
+  virtual void GetTuple(vtkIdType i, double* tuple);
+  virtual double GetComponent(vtkIdType i, int j);
+  double GetTuple1(vtkIdType i); // not virtual in vtkDataArray
+  virtual void* GetVoidPointer(vtkIdType id);
+  virtual vtkArrayIterator* NewIterator();
+  virtual vtkIdType LookupValue(vtkVariant value);
+  virtual void LookupValue(vtkVariant value, vtkIdList* ids);
+  virtual int GetDataType() { return VTK_FLOAT; }
+  virtual int GetDataTypeSize() { return static_cast<int>(sizeof(float)); }
+  virtual unsigned long GetActualMemorySize();
+  virtual void DataChanged();
+  virtual void Modified(); // also releases the copy of GetVoidPointer
+  virtual void ClearLookup() {}
+  virtual void Squeeze() {}
+
+  // Modifying the values is an error
+  virtual int Allocate(vtkIdType sz, vtkIdType ext = 1000);
+  virtual void Initialize();
+  virtual void SetNumberOfTuples(vtkIdType number);
+  virtual int Resize(vtkIdType numTuples);
+  virtual void SetVoidArray(void* array, vtkIdType size, int save);
+  virtual void* WriteVoidPointer(vtkIdType id, vtkIdType number);
+  virtual void SetTuple(vtkIdType i, const float* tuple);
+  virtual void SetTuple(vtkIdType i, const double* tuple);
+  virtual void InsertTuple(vtkIdType i, const float* tuple);
+  virtual void InsertTuple(vtkIdType i, const double* tuple);
+  virtual vtkIdType InsertNextTuple(const float* tuple);
+  virtual vtkIdType InsertNextTuple(const double* tuple);
+  virtual void InsertVariantValue(vtkIdType idx, vtkVariant value);
+  virtual void RemoveTuple(vtkIdType id);
+  virtual void RemoveFirstTuple();
+  virtual void RemoveLastTuple();
+
+protected:
+  UTChemImplicitArray();
+  ~UTChemImplicitArray();
+
+  virtual vtkObjectBase* NewInstanceInternal() const;
+
+  void SetShape(vtkIdType tuples, int components);
+  vtkFloatArray* GetMaterialized();
+  void ReadOnly(const char* method);
+
+  double Tuple[3];
+  vtkFloatArray* Materialized; // see GetVoidPointer
+
+private:
+  UTChemImplicitArray(const UTChemImplicitArray&); // Not implemented.
+  void operator=(const UTChemImplicitArray&); // Not implemented.
+};
+
+// The same value for every tuple, e.g. the volume of the cells of a grid
+// of constant dx, dy and dz.
+class UTChemConstantArray : public UTChemImplicitArray
+{
+public:
+  static UTChemConstantArray* New();
+  UTChemImplicitArrayTypeMacro(UTChemConstantArray, UTChemImplicitArray);
+
+  void SetConstant(double value, vtkIdType tuples);
+  virtual void ComputeTuple(vtkIdType i, double* tuple);
+
+protected:
+  UTChemConstantArray() : Value(0.0) {}
+
+  double Value;
+};
+
+// Cell values of a grid extruded in y, the product of a value of the x-z
+// section (nx*nz, I fastest) and a value of y (ny). For a Cartesian grid
+// the section holds dx*dz and y holds dy, giving the cell volumes.
+class UTChemSeparableArray : public UTChemImplicitArray
+{
+public:
+  static UTChemSeparableArray* New();
+  UTChemImplicitArrayTypeMacro(UTChemSeparableArray, UTChemImplicitArray);
+
+  void SetFactors(int nx, int nz, const std::vector<double>& section, const std::vector<double>& y);
+  virtual void ComputeTuple(vtkIdType i, double* tuple);
+
+protected:
+  UTChemSeparableArray() : NX(0), NZ(0) {}
+
+  int NX, NZ;
+  std::vector<double> Section, Y;
+};
+
+// Points of a curvilinear x-z section of (nx+1)*(nz+1) nodes (I fastest)
+// repeated at ny+1 y positions, ordered like a vtkStructuredGrid of
+// (nx+1)*(ny+1)*(nz+1) points. Depths of the section are positive down.
+class UTChemExtrudedPointArray : public UTChemImplicitArray
+{
+public:
+  static UTChemExtrudedPointArray* New();
+  UTChemImplicitArrayTypeMacro(UTChemExtrudedPointArray, UTChemImplicitArray);
+
+  void SetSection(int nx, int nz, const std::vector<double>& x, const std::vector<double>& depth, const std::vector<double>& y);
+  virtual void ComputeTuple(vtkIdType i, double* tuple);
+
+protected:
+  UTChemExtrudedPointArray() : NX(0), NZ(0) {}
+
+  int NX, NZ;
+  std::vector<double> X, Depth, Y;
+};
+
+#endif /* __UTChemImplicitArray_h */
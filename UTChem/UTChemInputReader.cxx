@@ -17,13 +17,21 @@ PURPOSE.  See the above copyright notice for more information.
 
 #include "UTChemInputReader.h"
 #include "UTChemTopReader.h"
+#include "UTChemMappedFile.h"
 #include "RVA_Util.h"
+#include "UTChemScanner.h"
+#include "UTChemImplicitArray.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
+#include <map>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 
 #include "vtkDataObject.h"
 #include "vtkDoubleArray.h"
@@ -33,6 +41,8 @@ PURPOSE.  See the above copyright notice for more information.
 #include "vtkStructuredGrid.h"
 #include "vtkPoints.h"
 #include "vtkSmartPointer.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h" // vtkSimpleMutexLock
 
 UTChemInputReader::UTChemInputReader(const std::string& input)
   : gridObject(NULL), objectType(0), xdim(NULL), ydim(NULL), zdim(NULL),
@@ -42,9 +52,10 @@ UTChemInputReader::UTChemInputReader(const std::string& input)
 	 ihystp(0), imes(0), imode(0), inoneq(0), ioutgms(0), ipalk(0), ipbio(0), ipcap(0), 
 	 ipctot(0), iper(0), ipgel(0), iphse(0), ipobs(0), ippres(0), ipsat(0), iptemp(0), 
 	 ireact(0), irkf(0), is3g(0), istop(0), itc(0), itreac(0), iunit(0), ivel(0), ng(0), 
-	 ngc(0), no(0), noth(0), nta(0), ntw(0), nx(0), ny(0), nz(0), cellCenters(NULL),
+	 ngc(0), no(0), noth(0), nta(0), ntw(0), nx(0), ny(0), nz(0), cellCenters(NULL), centersLock(vtkMutexLock::New()),
 	 tmax(0), compr(0), pstand(0), ipor1(0), ipermx(0), ipermy(0), ipermz(0), imod(0), 
-	 itranz(0), intg(0), idepth(0), ipress(0), iswi(0), icwi(0)
+	 itranz(0), intg(0), idepth(0), ipress(0), iswi(0), icwi(0),
+	 refCount(1), fileSize(-1), fileMTime(-1)
 {
 	// MVM: NO_FILE is perhaps a misnomer, as due to how this ctor gets called
 	// often it will result in a parseResult of NO_FILE, even though there is
@@ -63,7 +74,14 @@ UTChemInputReader::UTChemInputReader(const std::string& input)
 			std::string input_copy (input);
 			found = input_copy.rfind(key);
 			input_copy.replace(found, key.length(), "TOP");
-			top = new UTChemTopReader(input_copy.c_str(), nx, ny);
+			try {
+				top = new UTChemTopReader(input_copy.c_str(), nx, ny);
+			} catch (const std::exception&) {
+				top = NULL; // already reported by UTChemTopReader
+			}
+			if (top && top->isValid && icoord == 1) {
+				setupTopGridCoords();
+			}
 		}
 	}
 
@@ -116,10 +134,95 @@ UTChemInputReader::~UTChemInputReader()
 	points=NULL;
 	if (cellVolume!=NULL)
 		cellVolume->Delete();
+	centersLock->Delete();
+	for (size_t i = 0; i < cellProperties.size(); ++i)
+		cellProperties[i]->Delete();
 
 	delete top;
 }
 
+// Process wide registry of parsed INPUT decks, keyed by canonical path
+typedef std::map<std::string, UTChemInputReader*> UTChemInputRegistry;
+static UTChemInputRegistry inputRegistry;
+static vtkSimpleMutexLock inputRegistryLock;
+
+static std::string canonicalPath(const std::string& path)
+{
+#ifdef _WIN32
+  char buf[_MAX_PATH];
+  if (_fullpath(buf, path.c_str(), sizeof(buf)))
+    return buf;
+#else
+  char buf[PATH_MAX];
+  if (realpath(path.c_str(), buf))
+    return buf;
+#endif
+  return path;
+}
+
+UTChemInputReader* UTChemInputReader::acquire(const std::string& input)
+{
+  long long size = -1, mtime = -1;
+  if (input.empty() || !UTChemMappedFile::stat(input.c_str(), size, mtime)) {
+    return new UTChemInputReader(input); // nothing to share
+  }
+
+  std::string key = canonicalPath(input);
+
+  inputRegistryLock.Lock();
+  UTChemInputRegistry::iterator it = inputRegistry.find(key);
+  if (it != inputRegistry.end()) {
+    UTChemInputReader* info = it->second;
+    if (info->fileSize == size && info->fileMTime == mtime) {
+      info->refCount++;
+      inputRegistryLock.Unlock();
+      return info;
+    }
+    // INPUT changed on disk: current holders keep the old deck
+    info->registryKey.clear();
+    inputRegistry.erase(it);
+  }
+  inputRegistryLock.Unlock();
+
+  // Parse outside of the lock, INPUT decks with TOP files can take a while
+  UTChemInputReader* info = new UTChemInputReader(input);
+  info->fileSize = size;
+  info->fileMTime = mtime;
+
+  inputRegistryLock.Lock();
+  it = inputRegistry.find(key);
+  if (it != inputRegistry.end() && it->second->fileSize == size && it->second->fileMTime == mtime) {
+    // Someone else parsed it meanwhile
+    it->second->refCount++;
+    UTChemInputReader* shared = it->second;
+    inputRegistryLock.Unlock();
+    delete info;
+    return shared;
+  }
+  if (it == inputRegistry.end()) {
+    info->registryKey = key;
+    inputRegistry[key] = info;
+  }
+  inputRegistryLock.Unlock();
+  return info;
+}
+
+void UTChemInputReader::release(UTChemInputReader* info)
+{
+  if (!info)
+    return;
+
+  inputRegistryLock.Lock();
+  bool last = --info->refCount <= 0;
+  if (last && !info->registryKey.empty()) {
+    inputRegistry.erase(info->registryKey);
+  }
+  inputRegistryLock.Unlock();
+
+  if (last)
+    delete info;
+}
+
 int UTChemInputReader::canReadFile() {
   return parseResult != NO_FILE;
 }
@@ -498,94 +601,41 @@ UTChemInputReader::ParseState UTChemInputReader::readReservoirProperties()
   ss >> ipor1 >> ipermx >> ipermy >> ipermz >> imod;
 
   // Following sections depend on previous line
-  if (ipor1 == 0) {
-	  // Section 3.3.4
+  vtkFloatArray* permX = NULL;
+  if (ipor1 >= 0 && ipor1 <= 2) {
+	  // Section 3.3.4 constant, 3.3.5 1,nz or 3.3.6 1,nx*ny*nz
 	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipor1 == 1) {
-	  // Section 3.3.5 1,nz
-	  skipLines(3);
-	  getline(InputFile,str); 
-
-  }
-  else if (ipor1 == 2) {
-	  // Section 3.3.6 1, nx*ny*nz
-	  skipLines(3);
-	  std::string tmp;
-	  for (int i = 0; i < (nx * ny * nz); i++ )
-	  {
-		  InputFile >> tmp;
-	  }
-	  InputFile.ignore(1, '\n');
+	  readCellProperty("Porosity", ipor1);
   }
   
-  if (ipermx == 0) {
-	  // Section 3.3.7
+  if (ipermx >= 0 && ipermx <= 2) {
+	  // Section 3.3.7 constant, 3.3.8 1,nz or 3.3.9 1,nx*ny*nz
 	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermx == 1) {
-	  // Section 3.3.8 1,nz
-	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermx == 2) {
-	  // Section 3.3.9 1, nx*ny*nz
-	  skipLines(3);
-	  std::string tmp;
-	  for (int i = 0; i < (nx * ny * nz) ; i++ )
-	  {
-		  InputFile >> tmp; 
-	  }
-	  InputFile.ignore(1, '\n');
+	  permX = readCellProperty("PermX", ipermx);
   }
 
-  if (ipermy == 0 && icoord != 2) {
-	  // Section 3.3.10
-	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermy == 1 && icoord != 2) {
-      // Section 3.3.11 1, nz
-	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermy == 2 && icoord != 2) {
-	  // Section 3.3.12 1,nx*ny*nz
-	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermy == 3 && icoord != 2) {
-	  // Section 3.3.13
-	  skipLines(3);
-	  getline(InputFile,str);
+  if (icoord != 2) {
+	  if (ipermy >= 0 && ipermy <= 2) {
+		  // Section 3.3.10 constant, 3.3.11 1,nz or 3.3.12 1,nx*ny*nz
+		  skipLines(3);
+		  readCellProperty("PermY", ipermy);
+	  }
+	  else if (ipermy == 3) {
+		  // Section 3.3.13 factor of PERMX
+		  skipLines(3);
+		  scaleCellProperty("PermY", permX);
+	  }
   }
 
-  if (ipermz == 0) {
-	  // Section 3.3.14
-	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermz == 1) {
-	  // Section 3.3.15 1,nz
+  if (ipermz >= 0 && ipermz <= 2) {
+	  // Section 3.3.14 constant, 3.3.15 1,nz or 3.3.16 1,nx*ny*nz
 	  skipLines(3);
-	  getline(InputFile,str);
-  }
-  else if (ipermz == 2) {
-	  // Section 3.3.16 1,nx*ny*nz
-	  skipLines(3);
-	  std::string tmp;
-	  for (int i = 0; i < (nx*ny*nz); i++)
-	  {
-		  InputFile >> tmp;
-	  }
-	  InputFile.ignore(1, '\n');
+	  readCellProperty("PermZ", ipermz);
   }
   else if (ipermz == 3) {
-	  // Section 3.3.17
+	  // Section 3.3.17 factor of PERMX
 	  skipLines(3);
-	  getline(InputFile,str);
+	  scaleCellProperty("PermZ", permX);
   }
   
   // Section 3.3.18
@@ -670,36 +720,183 @@ void UTChemInputReader::setupRGridCoords()
 
 void UTChemInputReader::setupSGridCoords()
 {
-	// change to smartpointer
-	points = vtkPoints::New();
-
-	// note: the way the coords are given in the file is the
-	// equivalent to x-z-y fastest, but VTK expects x-y-z	
-
-	// change this - UTChem gives deltas, but VTK wants absolutes
-	// need to convert the dys to absolutes, x-z-y ordering messes up
-	// the obvious way to do this!
-    
-    // MVM: why is this converting ys to absolute positions, but not
-    // x and z?
+	// The x-z section of section 3.1.5 is given I fastest, (nx+1)*(nz+1) nodes.
+	// The grid is that section extruded in y, so the points are computed on
+	// access from the section and the y positions instead of being stored.
+	if ((int) xspace.size() != (nx + 1) * (nz + 1) || (int) yspace.size() != ny) {
+		vtkOutputWindowDisplayErrorText("Curvilinear section of the INPUT file does not match NX, NY and NZ");
+		return;
+	}
 
-    std::vector<double> y;
+	// UTChem gives dys, VTK wants positions
+	std::vector<double> y;
 	double ypos = 0.0;
 	y.push_back(ypos);
-	
-	for (int i = 1; i < ny+1; i++) {
-		ypos += yspace[i-1];
+	for (int j = 0; j < ny; j++) {
+		ypos += yspace[j];
 		y.push_back(ypos);
 	}
 
-	for (int k = 0; k <= nz; k++) {
-		for (int j = 0; j <= ny; j++) {
-			for (int i = 0; i <= nx; i++) {
-				points->InsertNextPoint(xspace[i], y.at(j), -zspace[k]);
+	UTChemExtrudedPointArray* section = UTChemExtrudedPointArray::New();
+	section->SetSection(nx, nz, xspace, zspace, y);
+	points = vtkPoints::New();
+	points->SetData(section);
+	section->Delete();
+}
 
+struct UTChemTopGridJob
+{
+	vtkPoints* points;
+	int nx, ny, nz;
+	const double* x;     // nx+1 node positions
+	const double* y;     // ny+1 node positions
+	const double* depth; // nz+1 depths below the top of a column
+	const double* top;   // nx*ny depths of the top of the columns
+};
+
+// Each thread fills the nodes of every NumberOfThreads-th row of columns
+static VTK_THREAD_RETURN_TYPE buildTopGridThread(void* arg)
+{
+	vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+	const UTChemTopGridJob* job = static_cast<const UTChemTopGridJob*>(info->UserData);
+	const int nx = job->nx, ny = job->ny, nz = job->nz;
+	const vtkIdType px = nx + 1;
+	const vtkIdType pxy = px * (ny + 1);
+
+	for (int j = info->ThreadID; j <= ny; j += info->NumberOfThreads) {
+		for (int i = 0; i <= nx; i++) {
+			// A node takes the mean top of the (up to 4) columns around it
+			double top = 0.0;
+			int columns = 0;
+			for (int jj = std::max(j - 1, 0); jj <= std::min(j, ny - 1); jj++) {
+				for (int ii = std::max(i - 1, 0); ii <= std::min(i, nx - 1); ii++) {
+					top += job->top[ii + jj * nx];
+					columns++;
+				}
+			}
+			top /= columns;
+			for (int k = 0; k <= nz; k++) {
+				job->points->SetPoint(i + j * px + k * pxy, job->x[i], job->y[j], -(top + job->depth[k]));
 			}
 		}
 	}
+	return VTK_THREAD_RETURN_VALUE;
+}
+
+// IDEPTH=4 (section 3.3.18): the TOP file gives the depth of the top of each
+// column of a Cartesian grid. The grid becomes a vtkStructuredGrid whose nodes
+// hang the layer thicknesses below those depths. The points are built once for
+// the shared deck, every reader and time step uses them.
+void UTChemInputReader::setupTopGridCoords()
+{
+	if ((!xspace.empty() && (int) xspace.size() != nx) ||
+		(!yspace.empty() && (int) yspace.size() != ny) ||
+		(!zspace.empty() && (int) zspace.size() != nz) || (int) top->topdim.size() < nx * ny) {
+		vtkOutputWindowDisplayErrorText("TOP file does not match the grid of the INPUT file, depths are ignored");
+		return;
+	}
+
+	std::vector<double> x(nx + 1, 0.0), y(ny + 1, 0.0), depth(nz + 1, 0.0);
+	for (int i = 0; i < nx; i++)
+		x[i + 1] = x[i] + (xspace.empty() ? dx1 : xspace[i]);
+	for (int j = 0; j < ny; j++)
+		y[j + 1] = y[j] + (yspace.empty() ? dy1 : yspace[j]);
+	for (int k = 0; k < nz; k++)
+		depth[k + 1] = depth[k] + (zspace.empty() ? dz1 : zspace[k]);
+
+	points = vtkPoints::New();
+	points->SetNumberOfPoints((vtkIdType) (nx + 1) * (ny + 1) * (nz + 1));
+
+	UTChemTopGridJob job = { points, nx, ny, nz, &x[0], &y[0], &depth[0], &top->topdim[0] };
+	vtkMultiThreader* threader = vtkMultiThreader::New();
+	threader->SetNumberOfThreads(std::max(1, std::min(threader->GetNumberOfThreads(), ny + 1)));
+	threader->SetSingleMethod(buildTopGridThread, &job);
+	threader->SingleMethodExecute();
+	threader->Delete();
+	points->Modified();
+}
+
+// Reads count values which may span several lines, including the n*value
+// repeat counts of Fortran list directed input. The rest of the last line is skipped.
+bool UTChemInputReader::readValues(int count, std::vector<float>& values)
+{
+  values.clear();
+  values.reserve(count);
+  std::string line;
+  while ((int) values.size() < count && getline(InputFile, line)) {
+    std::replace(line.begin(), line.end(), ',', ' ');
+    const char* p = line.c_str();
+    const char* end = p + line.length();
+    while ((int) values.size() < count) {
+      p = scanSkipSpace(p, end);
+      if (p >= end)
+        break;
+      const char* tokenEnd = scanSkipToken(p, end);
+      const char* star = (const char*) memchr(p, '*', tokenEnd - p);
+      int repeat = 1;
+      if (star) {
+        repeat = atoi(p);
+        p = star + 1;
+      }
+      float value;
+      bool isNumber;
+      scanFloat(p, tokenEnd, value, isNumber);
+      if (!isNumber || repeat < 1)
+        return false;
+      for (int r = 0; r < repeat && (int) values.size() < count; ++r)
+        values.push_back(value);
+      p = tokenEnd;
+    }
+  }
+  return (int) values.size() == count;
+}
+
+vtkFloatArray* UTChemInputReader::readCellProperty(const char* name, int form)
+{
+  const vtkIdType layerSize = (vtkIdType) nx * ny;
+  const int count = form == 0 ? 1 : (form == 1 ? nz : nx * ny * nz);
+  std::vector<float> values;
+  if (count < 1 || !readValues(count, values)) {
+    std::string msg("Could not read the ");
+    msg += name;
+    msg += " values of the INPUT file";
+    vtkOutputWindowDisplayErrorText(msg.c_str());
+    return NULL;
+  }
+
+  vtkFloatArray* array = vtkFloatArray::New();
+  array->SetName(name);
+  array->SetNumberOfTuples(layerSize * nz);
+  float* out = array->GetPointer(0);
+  if (form == 0) {
+    std::fill(out, out + layerSize * nz, values[0]);
+  }
+  else if (form == 1) {
+    for (int k = 0; k < nz; ++k)
+      std::fill(out + k * layerSize, out + (k + 1) * layerSize, values[k]);
+  }
+  else {
+    std::copy(values.begin(), values.end(), out); // I fastest, then J and K, as the VTK cells
+  }
+  cellProperties.push_back(array);
+  return array;
+}
+
+vtkFloatArray* UTChemInputReader::scaleCellProperty(const char* name, vtkFloatArray* source)
+{
+  std::vector<float> factor;
+  if (!readValues(1, factor) || !source) {
+    return NULL;
+  }
+  vtkFloatArray* array = vtkFloatArray::New();
+  array->SetName(name);
+  array->SetNumberOfTuples(source->GetNumberOfTuples());
+  const float* in = source->GetPointer(0);
+  float* out = array->GetPointer(0);
+  for (vtkIdType i = 0; i < source->GetNumberOfTuples(); ++i)
+    out[i] = factor[0] * in[i];
+  cellProperties.push_back(array);
+  return array;
 }
 
 // MVM: change to return void or elide
@@ -763,17 +960,20 @@ void UTChemInputReader::readCurvilinearXZ(std::string& str, std::vector<double>&
 	}
 }
 
+// Returns a new (empty) data object of the grid type, owned by the caller.
+// The deck is shared between readers, so gridObject itself is never handed out.
 vtkDataObject * UTChemInputReader::getObject(vtkInformation* info)
 {
   assert(gridObject);
   assert(info);
 
-  if(gridObject && info)
-    gridObject->SetPipelineInformation(info);
-  else {
-    vtkOutputWindowDisplayErrorText("No Grid Object or no vtkInformation! - determineGridType not called?");
+  if(gridObject && info) {
+    vtkDataObject* output = gridObject->NewInstance();
+    output->SetPipelineInformation(info);
+    return output;
   }
-  return gridObject;
+  vtkOutputWindowDisplayErrorText("No Grid Object or no vtkInformation! - determineGridType not called?");
+  return NULL;
 }
 
 void UTChemInputReader::determineGridType()
@@ -812,29 +1012,102 @@ int UTChemInputReader::getObjectType() const
 }
 
 // MVM: why not use the PV filter to calc cell volumes?
+// Volumes are never stored per cell: they are constant, or dx*dz of the x-z
+// section times dy (the area of the quadrilateral for curvilinear sections).
 void UTChemInputReader::calculateCellVolume()
 {
-	cellVolume = vtkFloatArray::New();
-	cellVolume->SetName("Cell_Volume");
-	if (!xspace.empty() && !yspace.empty() && !zspace.empty())
+	std::vector<double> section, dy;
+	if (icoord == 4 && (int) xspace.size() == (nx + 1) * (nz + 1) && (int) yspace.size() == ny)
 	{
-		for (int k=0; k<zspace.size(); k++)
+		const int px = nx + 1;
+		for (int k = 0; k < nz; k++)
 		{
-			for (int j=0; j<yspace.size(); j++)
+			for (int i = 0; i < nx; i++)
 			{
-				for (int i=0; i<xspace.size(); i++)
+				// Shoelace formula over the corners (i,k) (i+1,k) (i+1,k+1) (i,k+1)
+				const int corner[4] = { i + k * px, i + 1 + k * px, i + 1 + (k + 1) * px, i + (k + 1) * px };
+				double area = 0.0;
+				for (int c = 0; c < 4; c++)
 				{
-					cellVolume->InsertNextValue(xspace[i]*yspace[j]*zspace[k]);
+					const int n = corner[(c + 1) % 4];
+					area += xspace[corner[c]] * zspace[n] - xspace[n] * zspace[corner[c]];
 				}
+				section.push_back(fabs(area) / 2.0);
 			}
 		}
+		dy = yspace;
+	}
+	else if (icoord != 4 && (int) xspace.size() == nx && (int) yspace.size() == ny && (int) zspace.size() == nz)
+	{
+		for (int k = 0; k < nz; k++)
+		{
+			for (int i = 0; i < nx; i++)
+			{
+				section.push_back(xspace[i] * zspace[k]);
+			}
+		}
+		dy = yspace;
+	}
+
+	if (!section.empty())
+	{
+		UTChemSeparableArray* volume = UTChemSeparableArray::New();
+		volume->SetFactors(nx, nz, section, dy);
+		cellVolume = volume;
 	}
 	else
 	{
-		double volume = (dx1)*(dy1)*(dz1);
-		for (int i = 0; i<(nx*ny*nz); i++)
-			cellVolume->InsertNextValue(volume);
+		UTChemConstantArray* volume = UTChemConstantArray::New();
+		volume->SetConstant((dx1)*(dy1)*(dz1), (vtkIdType) nx * ny * nz);
+		cellVolume = volume;
 	}
+	cellVolume->SetName("Cell_Volume");
+}
+
+bool UTChemInputReader::getCellCenter(vtkIdType cellId, double center[3])
+{
+    if (!points || cellId < 0 || cellId >= (vtkIdType) nx * ny * nz) {
+        return false;
+    }
+
+    centersLock->Lock();
+    std::map<vtkIdType, CellCenter>::const_iterator it = curvilinearCenters.find(cellId);
+    bool cached = it != curvilinearCenters.end();
+    if (cached) {
+        center[0] = it->second.x[0];
+        center[1] = it->second.x[1];
+        center[2] = it->second.x[2];
+    }
+    centersLock->Unlock();
+    if (cached) {
+        return true;
+    }
+
+    // Points are ordered like those of a vtkStructuredGrid of (nx+1)*(ny+1)*(nz+1) points
+    const vtkIdType i = cellId % nx;
+    const vtkIdType j = (cellId / nx) % ny;
+    const vtkIdType k = cellId / ((vtkIdType) nx * ny);
+    const vtkIdType px = nx + 1;
+    const vtkIdType pxy = px * (ny + 1);
+
+    CellCenter c = { { 0.0, 0.0, 0.0 } };
+    for (int corner = 0; corner < 8; ++corner) {
+        vtkIdType pointId = (i + (corner & 1)) + (j + ((corner >> 1) & 1)) * px + (k + (corner >> 2)) * pxy;
+        double p[3];
+        points->GetPoint(pointId, p);
+        c.x[0] += p[0];
+        c.x[1] += p[1];
+        c.x[2] += p[2];
+    }
+    for (int n = 0; n < 3; ++n) {
+        c.x[n] /= 8.0;
+        center[n] = c.x[n];
+    }
+
+    centersLock->Lock();
+    curvilinearCenters[cellId] = c;
+    centersLock->Unlock();
+    return true;
 }
 
 float** UTChemInputReader::getCellCenters()
@@ -893,9 +1166,8 @@ float** UTChemInputReader::getCellCenters()
             }
         }
         else if (getObjectType() == 2) {
-            // Curvilinear 
-            // MVM: This is currently handled directly in UTChemWellReader.cxx because
-            // the above strategy is only valid for ortho-normal grids. 
+            // Curvilinear: the above strategy is only valid for ortho-normal grids,
+            // see getCellCenter
             return NULL;
         }
         else {
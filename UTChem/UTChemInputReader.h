@@ -30,6 +30,7 @@ PURPOSE.  See the above copyright notice for more information.
 #include "vtkDoubleArray.h"
 #include "vtkPoints.h"
 #include "vtkFloatArray.h"
+#include "vtkMutexLock.h"
 #include "UTChemTopReader.h"
 
 struct UTChemInputReader
@@ -40,6 +41,12 @@ struct UTChemInputReader
 	UTChemInputReader(const std::string& input);
 	~UTChemInputReader();
 
+	// Readers of the same run share one parsed INPUT deck (and its geometry).
+	// acquire returns a reference counted instance keyed by the canonical path,
+	// size and modification time of the file. Each acquire needs a release.
+	static UTChemInputReader* acquire(const std::string& input);
+	static void release(UTChemInputReader* info);
+
 	// Well data information
 	struct WellData
 	{
@@ -65,7 +72,9 @@ struct UTChemInputReader
 	std::vector<int> icf, iprflag;
 	std::vector<double> xspace, yspace, zspace;
 	vtkDoubleArray * xdim, * ydim, * zdim;
-	vtkFloatArray * cellVolume;
+	vtkDataArray * cellVolume; // computed on access, see UTChemImplicitArray
+	// Porosity, PermX, PermY and PermZ as given in section 3.3, shared by all outputs
+	std::vector<vtkFloatArray*> cellProperties;
 	vtkPoints * points;
 	std::map<int, WellData> wellInfo;
 
@@ -74,6 +83,9 @@ struct UTChemInputReader
 
 	int canReadFile();
 	float** getCellCenters();
+	// Center of one cell of a curvilinear grid, computed from the 8 corner points
+	// the way vtkCellCenters does. Cached, as all wells of a run share the deck.
+	bool getCellCenter(vtkIdType cellId, double center[3]);
 
 	UTChemTopReader * top;
 
@@ -93,12 +105,16 @@ private:
 	int readIVarInLine(int numVars, const char* str, std::vector<int>& container);
 	void readRegionalCoords(std::string& str, std::vector<double>& container, int numExpected=-1);
 	void readCurvilinearXZ(std::string&, std::vector<double>&, std::vector<double>&);
+	bool readValues(int count, std::vector<float>& values);
+	vtkFloatArray* readCellProperty(const char* name, int form); // form 0 constant, 1 per layer, 2 per cell
+	vtkFloatArray* scaleCellProperty(const char* name, vtkFloatArray* source); // reads the factor
 
 
 	// Extra setup functions
 	void determineGridType();
 	void setupRGridCoords();
 	void setupSGridCoords();
+	void setupTopGridCoords();
 	void calculateCellVolume();
 
 	std::ifstream InputFile;
@@ -106,6 +122,14 @@ private:
 	bool isValid;
 	vtkDataObject * gridObject;
 	float ** cellCenters;
+	struct CellCenter { double x[3]; };
+	std::map<vtkIdType, CellCenter> curvilinearCenters; // see getCellCenter
+	vtkMutexLock * centersLock;
+
+	// Registry bookkeeping, see acquire()
+	int refCount;
+	std::string registryKey; // empty if not shared
+	long long fileSize, fileMTime;
 };
 
 #endif /* __UTChemInputReader_h */
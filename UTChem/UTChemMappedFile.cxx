@@ -0,0 +1,175 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemMappedFile
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "UTChemMappedFile.h"
+
+#include <fstream>
+#include <new>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+UTChemMappedFile::UTChemMappedFile()
+  : data(NULL), length(0), opened(false), copied(false)
+#ifdef _WIN32
+  , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#else
+  , fd(-1)
+#endif
+{
+}
+
+UTChemMappedFile::~UTChemMappedFile()
+{
+  close();
+}
+
+bool UTChemMappedFile::stat(const char* filename, long long& size, long long& mtime)
+{
+#ifdef _WIN32
+  struct _stat64 info;
+  if (!filename || _stat64(filename, &info) != 0) {
+    return false;
+  }
+#else
+  struct ::stat info;
+  if (!filename || ::stat(filename, &info) != 0) {
+    return false;
+  }
+#endif
+  size = (long long) info.st_size;
+  mtime = (long long) info.st_mtime;
+  return true;
+}
+
+bool UTChemMappedFile::open(const char* filename, bool copy)
+{
+  close();
+
+  long long fileSize = 0, mtime = 0;
+  if (!stat(filename, fileSize, mtime)) {
+    return false;
+  }
+  if ((unsigned long long) fileSize > (unsigned long long) ((size_t) -1)) {
+    return false; // does not fit in the address space
+  }
+  length = (size_t) fileSize;
+
+  if (copy) {
+    return readIntoMemory(filename);
+  }
+
+#ifdef _WIN32
+  fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    length = 0;
+    return false;
+  }
+  if (length > 0) {
+    mappingHandle = CreateFileMappingA((HANDLE) fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle) {
+      data = (const char*) MapViewOfFile((HANDLE) mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!data) {
+      close();
+      length = (size_t) fileSize;
+      return readIntoMemory(filename);
+    }
+  }
+#else
+  fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    length = 0;
+    return false;
+  }
+  if (length > 0) {
+    void* ptr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close();
+      length = (size_t) fileSize;
+      return readIntoMemory(filename);
+    }
+    data = (const char*) ptr;
+    // Files are mostly read front to back
+    madvise(ptr, length, MADV_SEQUENTIAL);
+  }
+#endif
+  opened = true;
+  return true;
+}
+
+// Reads up to length bytes, fewer if the file was truncated since it was stat'ed
+bool UTChemMappedFile::readIntoMemory(const char* filename)
+{
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  char* buffer = length > 0 ? new (std::nothrow) char[length] : NULL;
+  if (!in || (length > 0 && !buffer)) {
+    delete [] buffer;
+    length = 0;
+    return false;
+  }
+  in.read(buffer, (std::streamsize) length);
+  length = (size_t) in.gcount();
+  data = buffer;
+  copied = true;
+  opened = true;
+  return true;
+}
+
+void UTChemMappedFile::close()
+{
+  if (copied) {
+    delete [] data;
+    data = NULL;
+    length = 0;
+    copied = false;
+    opened = false;
+  }
+#ifdef _WIN32
+  if (data) {
+    UnmapViewOfFile(data);
+  }
+  if (mappingHandle) {
+    CloseHandle((HANDLE) mappingHandle);
+  }
+  if (fileHandle != INVALID_HANDLE_VALUE) {
+    CloseHandle((HANDLE) fileHandle);
+  }
+  mappingHandle = NULL;
+  fileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (data) {
+    munmap((void*) data, length);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+#endif
+  data = NULL;
+  length = 0;
+  opened = false;
+}
@@ -0,0 +1,65 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemMappedFile
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __UTChemMappedFile_h
+#define __UTChemMappedFile_h
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+// Files that cannot be mapped (e.g. on file systems without mmap) are read
+// into memory instead, as are files opened with copy set: a mapping faults
+// (SIGBUS) when another process truncates the file while it is read, which a
+// running simulation may do. Either way the whole file has to fit in the
+// address space, so open() fails for files larger than that (several GB on
+// 32-bit builds), which the old line by line stream parsing could read.
+class UTChemMappedFile
+{
+public:
+  UTChemMappedFile();
+  ~UTChemMappedFile();
+
+  bool open(const char* filename, bool copy = false);
+  void close();
+
+  bool isOpen() const { return opened; }
+  const char* begin() const { return data; }
+  const char* end() const { return data + length; }
+  size_t size() const { return length; }
+
+  // Size in bytes and modification time of a file, false if it does not exist
+  static bool stat(const char* filename, long long& size, long long& mtime);
+
+private:
+  UTChemMappedFile(const UTChemMappedFile&); // Not implemented.
+  void operator=(const UTChemMappedFile&); // Not implemented.
+
+  bool readIntoMemory(const char* filename);
+
+  const char* data;
+  size_t length;
+  bool opened;
+  bool copied; // data was read into memory (new[]) rather than mapped
+#ifdef _WIN32
+  void* fileHandle;
+  void* mappingHandle;
+#else
+  int fd;
+#endif
+};
+
+#endif /* __UTChemMappedFile_h */
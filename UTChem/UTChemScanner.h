@@ -0,0 +1,218 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemScanner
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __UTChemScanner_h
+#define __UTChemScanner_h
+
+// Allocation free number scanning over a [ptr,end) character range,
+// used instead of iostreams on the hot paths of the UTChem readers.
+// Understands what gfortran writes: NaN, Infinity, E/D exponents and
+// the exponent-only form of wide exponents (e.g. 0.1234-100).
+
+#include <cstddef>
+#include <limits>
+
+static inline bool scanIsSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool scanIsDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static inline const char* scanSkipSpace(const char* p, const char* end)
+{
+  while (p < end && scanIsSpace(*p))
+    p++;
+  return p;
+}
+
+static inline const char* scanSkipToken(const char* p, const char* end)
+{
+  while (p < end && !scanIsSpace(*p))
+    p++;
+  return p;
+}
+
+static inline double scanPow10(int e)
+{
+  static const double table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  double result = 1.0;
+  bool negative = e < 0;
+  if (negative)
+    e = -e;
+  while (e > 22) {
+    result *= 1e22;
+    e -= 22;
+  }
+  result *= table[e];
+  return negative ? 1.0 / result : result;
+}
+
+// Case insensitive match of a word at p
+static inline bool scanMatchWord(const char* p, const char* end, const char* word)
+{
+  for (; *word; ++word, ++p) {
+    if (p >= end || (*p | 0x20) != (*word | 0x20))
+      return false;
+  }
+  return true;
+}
+
+// Scans one whitespace separated number starting at p (leading space is skipped).
+// Returns the position after the token, or p unchanged if there was no token left.
+// Tokens that are not numbers are consumed and yield NaN; isNumber tells them apart.
+static inline const char* scanDouble(const char* p, const char* end, double& value, bool& isNumber)
+{
+  p = scanSkipSpace(p, end);
+  isNumber = false;
+  value = std::numeric_limits<double>::quiet_NaN();
+  if (p >= end)
+    return p;
+
+  bool negative = false;
+  if (*p == '-' || *p == '+') {
+    negative = *p == '-';
+    p++;
+  }
+
+  if (p < end && (*p == 'N' || *p == 'n' || *p == 'I' || *p == 'i')) {
+    if (scanMatchWord(p, end, "inf")) {
+      value = negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+      isNumber = true;
+    }
+    // NaN (or anything else) stays NaN
+    return scanSkipToken(p, end);
+  }
+
+  unsigned long long mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  for (; p < end && scanIsDigit(*p); ++p, ++digits) {
+    if (mantissa < 100000000000000000ULL)
+      mantissa = mantissa * 10 + (*p - '0');
+    else
+      exponent++; // precision beyond 17 digits is irrelevant for float/double output
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && scanIsDigit(*p); ++p, ++digits) {
+      if (mantissa < 100000000000000000ULL) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (digits == 0) {
+    return scanSkipToken(p, end); // not a number
+  }
+
+  // Fortran exponents: 1.0E+05, 1.0D+05, 1.0e5 and 1.0-100
+  if (p < end && (*p == 'E' || *p == 'e' || *p == 'D' || *p == 'd' || *p == '+' || *p == '-')) {
+    const char* q = p;
+    if (*q != '+' && *q != '-')
+      q++;
+    bool negativeExponent = false;
+    if (q < end && (*q == '+' || *q == '-')) {
+      negativeExponent = *q == '-';
+      q++;
+    }
+    if (q < end && scanIsDigit(*q)) {
+      int e = 0;
+      for (; q < end && scanIsDigit(*q); ++q) {
+        if (e < 10000)
+          e = e * 10 + (*q - '0');
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  value = (double) mantissa;
+  if (exponent)
+    value *= scanPow10(exponent);
+  if (negative)
+    value = -value;
+  isNumber = true;
+
+  // Ignore trailing garbage glued to the number
+  return scanSkipToken(p, end);
+}
+
+static inline const char* scanFloat(const char* p, const char* end, float& value, bool& isNumber)
+{
+  double d;
+  p = scanDouble(p, end, d, isNumber);
+  value = (float) d;
+  return p;
+}
+
+// Scans count floats into output. Returns the position after the last
+// value or NULL if the range ends early. Non-numbers are stored as NaN
+// and counted in notNumbers.
+static inline const char* scanFloats(const char* p, const char* end, float* output, int count, int& notNumbers)
+{
+  for (int i = 0; i < count; ++i) {
+    bool isNumber;
+    p = scanSkipSpace(p, end);
+    if (p >= end)
+      return NULL;
+    const char* next = scanFloat(p, end, output[i], isNumber);
+    if (!isNumber)
+      notNumbers++;
+    p = next;
+  }
+  return p;
+}
+
+// Moves past count whitespace separated values without converting them.
+// Returns NULL if the range ends early.
+static inline const char* scanSkipValues(const char* p, const char* end, int count)
+{
+  for (int i = 0; i < count; ++i) {
+    p = scanSkipSpace(p, end);
+    if (p >= end)
+      return NULL;
+    p = scanSkipToken(p, end);
+  }
+  return p;
+}
+
+// Integers (e.g. column and row indices of PROF tables)
+static inline const char* scanInt(const char* p, const char* end, int& value, bool& isNumber)
+{
+  p = scanSkipSpace(p, end);
+  isNumber = false;
+  value = 0;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  for (; p < end && scanIsDigit(*p); ++p) {
+    value = value * 10 + (*p - '0');
+    isNumber = true;
+  }
+  if (negative)
+    value = -value;
+  return p;
+}
+
+#endif /* __UTChemScanner_h */
@@ -0,0 +1,354 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemSidecar
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "UTChemSidecar.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+static const char SIDECAR_MAGIC[8] = { 'R','V','A','S','I','D','E','1' };
+static const unsigned SIDECAR_HEADER_SIZE = 40;
+static const unsigned RECORD_HEADER_SIZE = 16;
+static const unsigned TAG_INDX = 0x58444e49; // "INDX"
+static const unsigned TAG_STEP = 0x50455453; // "STEP"
+
+// The file layout is little-endian; values are copied as-is so other hosts do not use sidecars
+static bool hostIsLittleEndian()
+{
+  const unsigned one = 1;
+  return *(const unsigned char*)&one == 1;
+}
+
+// Bounds checked reads from the mapped file
+template <class T> static bool readValue(const char*& ptr, const char* end, T& value)
+{
+  if (end - ptr < (ptrdiff_t) sizeof(T)) {
+    return false;
+  }
+  memcpy(&value, ptr, sizeof(T));
+  ptr += sizeof(T);
+  return true;
+}
+
+template <class T> static void writeValue(std::ofstream& out, T value)
+{
+  out.write((const char*)&value, sizeof(T));
+}
+
+static unsigned paddedLength(unsigned len)
+{
+  return (len + 3) & ~3u;
+}
+
+UTChemSidecar::UTChemSidecar(const std::string& source)
+  : sourceFile(source), fileName(getSidecarFileName(source)),
+  sourceSize(-1), sourceMTime(-1), nx(0), ny(0), nz(0), valid(false), remap(false), arraysListed(false)
+{
+}
+
+UTChemSidecar::~UTChemSidecar()
+{
+  close();
+}
+
+std::string UTChemSidecar::getSidecarFileName(const std::string& source)
+{
+  return source + ".rva";
+}
+
+void UTChemSidecar::close()
+{
+  mapped.close();
+  index.clear();
+  arrays.clear();
+  arraysListed = false;
+  steps.clear();
+  valid = false;
+  remap = false;
+}
+
+bool UTChemSidecar::open(int nx, int ny, int nz)
+{
+  close();
+  if (!hostIsLittleEndian() || !UTChemMappedFile::stat(sourceFile.c_str(), sourceSize, sourceMTime)) {
+    return false;
+  }
+  this->nx = nx;
+  this->ny = ny;
+  this->nz = nz;
+  valid = mapAndScan() && !index.empty();
+  if (!valid) {
+    close();
+  }
+  return valid;
+}
+
+// Maps the sidecar, checks the header against the source file and collects the records
+bool UTChemSidecar::mapAndScan()
+{
+  mapped.close();
+  index.clear();
+  arrays.clear();
+  arraysListed = false;
+  steps.clear();
+  remap = false;
+
+  if (!mapped.open(fileName.c_str()) || mapped.size() < SIDECAR_HEADER_SIZE) {
+    return false;
+  }
+
+  const char* ptr = mapped.begin();
+  const char* end = mapped.end();
+  long long size = 0, mtime = 0;
+  int dims[4] = { 0, 0, 0, 0 };
+
+  if (memcmp(ptr, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC)) != 0) {
+    return false;
+  }
+  ptr += sizeof(SIDECAR_MAGIC);
+  readValue(ptr, end, size);
+  readValue(ptr, end, mtime);
+  for (int i = 0; i < 4; ++i) {
+    readValue(ptr, end, dims[i]);
+  }
+  if (size != sourceSize || mtime != sourceMTime || dims[0] != nx || dims[1] != ny || dims[2] != nz) {
+    return false; // stale
+  }
+
+  const long long tuples = (long long) nx * ny * nz;
+
+  while (end - ptr >= (ptrdiff_t) RECORD_HEADER_SIZE) {
+    unsigned tag = 0, reserved = 0;
+    unsigned long long payload = 0;
+    readValue(ptr, end, tag);
+    readValue(ptr, end, reserved);
+    readValue(ptr, end, payload);
+    if (payload > (unsigned long long) (end - ptr)) {
+      break; // truncated record, e.g. an interrupted write
+    }
+    const char* recordEnd = ptr + payload;
+
+    if (tag == TAG_INDX) {
+      unsigned count = 0;
+      if (!readValue(ptr, recordEnd, count)) {
+        return false;
+      }
+      for (unsigned i = 0; i < count; ++i) {
+        UTChemTimeStepEntry entry;
+        long long offset = 0;
+        unsigned blockCount = 0;
+        if (!readValue(ptr, recordEnd, entry.time) || !readValue(ptr, recordEnd, offset)
+            || !readValue(ptr, recordEnd, blockCount)) {
+          return false;
+        }
+        entry.offset = (std::streamoff) offset;
+        for (unsigned b = 0; b < blockCount; ++b) {
+          long long block = 0;
+          if (!readValue(ptr, recordEnd, block)) {
+            return false;
+          }
+          entry.blocks.push_back((std::streamoff) block);
+        }
+        index.push_back(entry);
+      }
+      unsigned arrayCount = 0;
+      if (readValue(ptr, recordEnd, arrayCount)) { // absent in sidecars written before the list was stored
+        for (unsigned i = 0; i < arrayCount; ++i) {
+          ArrayLayers array;
+          unsigned nameLength = 0;
+          if (!readValue(ptr, recordEnd, array.layers) || !readValue(ptr, recordEnd, nameLength)
+              || recordEnd - ptr < (ptrdiff_t) paddedLength(nameLength)) {
+            return false;
+          }
+          array.name.assign(ptr, nameLength);
+          ptr += paddedLength(nameLength);
+          arrays.push_back(array);
+        }
+        arraysListed = true;
+      }
+    }
+    else if (tag == TAG_STEP) {
+      unsigned step = 0, count = 0;
+      std::vector<Slab> arrays;
+      bool ok = readValue(ptr, recordEnd, step) && readValue(ptr, recordEnd, count);
+      for (unsigned i = 0; ok && i < count; ++i) {
+        Slab slab;
+        unsigned nameLength = 0;
+        ok = readValue(ptr, recordEnd, slab.key) && readValue(ptr, recordEnd, slab.components)
+          && readValue(ptr, recordEnd, nameLength) && slab.components > 0
+          && recordEnd - ptr >= (ptrdiff_t) paddedLength(nameLength);
+        if (!ok) {
+          break;
+        }
+        slab.name.assign(ptr, nameLength);
+        ptr += paddedLength(nameLength);
+        long long bytes = tuples * slab.components * (long long) sizeof(float);
+        if (recordEnd - ptr < bytes) {
+          ok = false;
+          break;
+        }
+        slab.values = (const float*) ptr;
+        ptr += bytes;
+        arrays.push_back(slab);
+      }
+      if (ok) {
+        steps[step] = arrays; // later records replace earlier ones
+      }
+    }
+    ptr = recordEnd; // skip unknown records
+  }
+  return true;
+}
+
+bool UTChemSidecar::hasStep(unsigned step)
+{
+  if (!valid) {
+    return false;
+  }
+  if (remap && !mapAndScan()) {
+    close();
+    return false;
+  }
+  return steps.count(step) > 0;
+}
+
+const std::vector<UTChemSidecar::Slab>& UTChemSidecar::getStep(unsigned step)
+{
+  static const std::vector<Slab> none;
+  if (!hasStep(step)) {
+    return none;
+  }
+  return steps[step];
+}
+
+bool UTChemSidecar::create(int nx, int ny, int nz, const std::vector<UTChemTimeStepEntry>& entries,
+                           const std::vector<ArrayLayers>& arrayList)
+{
+  close();
+  if (!hostIsLittleEndian() || !UTChemMappedFile::stat(sourceFile.c_str(), sourceSize, sourceMTime)) {
+    return false;
+  }
+  this->nx = nx;
+  this->ny = ny;
+  this->nz = nz;
+
+  std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false; // e.g. read-only directory; the reader works without a sidecar
+  }
+
+  unsigned long long payload = sizeof(unsigned);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    payload += sizeof(double) + sizeof(long long) + sizeof(unsigned) + entries[i].blocks.size() * sizeof(long long);
+  }
+  payload += sizeof(unsigned);
+  for (size_t i = 0; i < arrayList.size(); ++i) {
+    payload += sizeof(int) + sizeof(unsigned) + paddedLength((unsigned) arrayList[i].name.length());
+  }
+
+  out.write(SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+  writeValue(out, sourceSize);
+  writeValue(out, sourceMTime);
+  writeValue(out, nx);
+  writeValue(out, ny);
+  writeValue(out, nz);
+  writeValue(out, (int) 0);
+
+  writeValue(out, TAG_INDX);
+  writeValue(out, (unsigned) 0);
+  writeValue(out, payload);
+  writeValue(out, (unsigned) entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    writeValue(out, entries[i].time);
+    writeValue(out, (long long) entries[i].offset);
+    writeValue(out, (unsigned) entries[i].blocks.size());
+    for (size_t b = 0; b < entries[i].blocks.size(); ++b) {
+      writeValue(out, (long long) entries[i].blocks[b]);
+    }
+  }
+  writeValue(out, (unsigned) arrayList.size());
+  for (size_t i = 0; i < arrayList.size(); ++i) {
+    static const char padding[4] = { 0, 0, 0, 0 };
+    unsigned nameLength = (unsigned) arrayList[i].name.length();
+    writeValue(out, arrayList[i].layers);
+    writeValue(out, nameLength);
+    out.write(arrayList[i].name.c_str(), nameLength);
+    out.write(padding, paddedLength(nameLength) - nameLength);
+  }
+  out.close();
+
+  if (out.fail()) {
+    remove(fileName.c_str());
+    return false;
+  }
+  index = entries;
+  arrays = arrayList;
+  arraysListed = true;
+  valid = true;
+  remap = true; // map lazily when a step is looked up
+  return true;
+}
+
+bool UTChemSidecar::appendStep(unsigned step, const std::vector<Slab>& arrays)
+{
+  if (!valid) {
+    return false;
+  }
+
+  long long size = 0, mtime = 0;
+  if (!UTChemMappedFile::stat(sourceFile.c_str(), size, mtime) || size != sourceSize || mtime != sourceMTime) {
+    close(); // source changed underneath us
+    return false;
+  }
+
+  const unsigned long long tuples = (unsigned long long) nx * ny * nz;
+  unsigned long long payload = 2 * sizeof(unsigned);
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    payload += 3 * sizeof(int) + paddedLength((unsigned) arrays[i].name.length())
+      + tuples * arrays[i].components * sizeof(float);
+  }
+
+  // Some platforms refuse to extend a file with an open mapping
+  mapped.close();
+  steps.clear();
+  remap = true;
+
+  std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+  if (!out.is_open()) {
+    return false;
+  }
+  writeValue(out, TAG_STEP);
+  writeValue(out, (unsigned) 0);
+  writeValue(out, payload);
+  writeValue(out, step);
+  writeValue(out, (unsigned) arrays.size());
+  for (size_t i = 0; i < arrays.size(); ++i) {
+    const Slab& slab = arrays[i];
+    static const char padding[4] = { 0, 0, 0, 0 };
+    unsigned nameLength = (unsigned) slab.name.length();
+    writeValue(out, slab.key);
+    writeValue(out, slab.components);
+    writeValue(out, nameLength);
+    out.write(slab.name.c_str(), nameLength);
+    out.write(padding, paddedLength(nameLength) - nameLength);
+    out.write((const char*) slab.values, (std::streamsize) (tuples * slab.components * sizeof(float)));
+  }
+  out.close();
+  return !out.fail();
+}
@@ -0,0 +1,101 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemSidecar
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Duggirala, D McWherter, U Yadav
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#ifndef __UTChemSidecar_h
+#define __UTChemSidecar_h
+
+#include <ios>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "UTChemMappedFile.h"
+
+// Location of one time step inside a UTChem output file
+struct UTChemTimeStepEntry
+{
+  double time;
+  std::streamoff offset; // start of the TIME line (or first block for timeless files), -1 if unknown
+  std::vector<std::streamoff> blocks; // start of each "... IN LAYER n" header
+};
+
+// Index and binary array cache stored next to a UTChem output file (FILE.rva).
+// Layout (little-endian):
+//   header:  "RVASIDE1", int64 source size, int64 source mtime, int32 nx, ny, nz, int32 0
+//   records: uint32 tag, uint32 0, uint64 payload size, payload
+//     INDX:  uint32 steps, per step: double time, int64 offset, uint32 n, int64 blocks[n],
+//            uint32 arrays, per array: int32 layers, uint32 name length, name (padded to 4 bytes)
+//     STEP:  uint32 step, uint32 arrays, per array: int32 key, int32 components,
+//            uint32 name length, name (padded to 4 bytes), float values[nx*ny*nz*components]
+// The sidecar is ignored as soon as the size or mtime of the source file changes.
+class UTChemSidecar
+{
+public:
+  struct Slab
+  {
+    int key; // phase index used by UTChemAsciiReader
+    int components;
+    std::string name;
+    const float* values; // points into the mapped sidecar (or the caller's array when appending)
+  };
+
+  struct ArrayLayers
+  {
+    std::string name; // as reported by UTChemAsciiReader::getMeaningfulArrayName
+    int layers; // highest layer written for the array
+  };
+
+  UTChemSidecar(const std::string& sourceFile);
+  ~UTChemSidecar();
+
+  static std::string getSidecarFileName(const std::string& sourceFile);
+
+  // Maps an existing sidecar, false if missing, stale or written for other dimensions
+  bool open(int nx, int ny, int nz);
+  void close();
+
+  const std::vector<UTChemTimeStepEntry>& getIndex() const { return index; }
+  bool hasArrayList() const { return valid && arraysListed; } // false for sidecars written without it
+  const std::vector<ArrayLayers>& getArrays() const { return arrays; }
+  bool hasStep(unsigned step);
+  const std::vector<Slab>& getStep(unsigned step);
+
+  // Replaces any previous sidecar with one holding only the header and index
+  bool create(int nx, int ny, int nz, const std::vector<UTChemTimeStepEntry>& steps,
+              const std::vector<ArrayLayers>& arrays);
+  bool appendStep(unsigned step, const std::vector<Slab>& arrays);
+
+private:
+  UTChemSidecar(const UTChemSidecar&); // Not implemented.
+  void operator=(const UTChemSidecar&); // Not implemented.
+
+  bool mapAndScan();
+
+  std::string sourceFile;
+  std::string fileName;
+  long long sourceSize, sourceMTime;
+  int nx, ny, nz;
+  bool valid; // header matches the source file
+  bool remap; // records were appended since the file was mapped
+  UTChemMappedFile mapped;
+  std::vector<UTChemTimeStepEntry> index;
+  std::vector<ArrayLayers> arrays;
+  bool arraysListed; // the INDX record holds the array list
+  std::map<unsigned, std::vector<Slab> > steps;
+};
+
+#endif /* __UTChemSidecar_h */
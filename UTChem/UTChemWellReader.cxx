@@ -18,10 +18,12 @@ PURPOSE.  See the above copyright notice for more information.
 // Include our header
 #include "UTChemWellReader.h"
 #include "UTChemInputReader.h"
+#include "UTChemScanner.h"
 
 // Standard libraries
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -39,8 +41,6 @@ PURPOSE.  See the above copyright notice for more information.
 #include "vtkTable.h"
 #include "vtkSmartPointer.h"
 #include "vtkVertex.h"
-#include "vtkStructuredGrid.h"
-#include "vtkCellCenters.h"
 #include <RVA_Util.h>
 
 // --------------------------------------------------------
@@ -91,29 +91,24 @@ int UTChemWellReader::RequestData(vtkInformation* vtkNotUsed(request),
     vtkInformation* outInfo = outputVector->GetInformationObject(1);
     vtkTable* table = vtkTable::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
 
-    assert(varCount == dataLabel.size());
-    assert( data.size() == varCount * timeStepCount);
-    if (!table || varCount != dataLabel.size() || data.size() != varCount * timeStepCount) {
+    assert(varCount == dataLabel.size() && varCount == columns.size());
+    assert( valueCount >= varCount * timeStepCount); // follow mode may have part of a row
+    if (!table || varCount != dataLabel.size() || varCount != columns.size() || valueCount < varCount * timeStepCount) {
         return 0; // Things have gone badly wrong.
     }
 
-    // creating empty arrays to hold points
+    // Columns are copied as a whole, the rows of a partially written row are left out
     for (int i = 0; i < varCount; i++) {
         vtkFloatArray * col = vtkFloatArray::New();
         col->SetName(dataLabel[i].c_str()); // adding data labels
+        col->SetNumberOfTuples(timeStepCount);
+        if (timeStepCount > 0) {
+            memcpy(col->GetPointer(0), &columns[i][0], timeStepCount * sizeof(float));
+        }
         table->AddColumn(col);
         col->Delete();
     }
 
-    table->SetNumberOfRows(timeStepCount);
-
-    // adding data points to all row, col positions
-    for (int row = 0; row < timeStepCount; row++) {
-        for (int col = 0; col < varCount; col++) {
-            table->SetValue(row, col, data[row*varCount+col]);
-        }
-    }
-
     // Visual information
     vtkInformation* outViz = outputVector->GetInformationObject(0);
     vtkPolyData* data = vtkPolyData::SafeDownCast(outViz->Get(vtkDataObject::DATA_OBJECT()));
@@ -136,7 +131,8 @@ int UTChemWellReader::RequestInformation( vtkInformation *vtkNotUsed(request),
         vtkErrorMacro(<<"Trying to reading file more than once!");
     } 
     else {
-        int success = readFile(); // 0 if failed, 1 if successful
+        // In follow mode only the rows appended since the last update are parsed
+        int success = (FollowFile && varCount > 0) ? readAppendedLines() : readFile(); // 0 if failed, 1 if successful
 
         if (!success) {
             vtkErrorMacro("File parsing failed");
@@ -179,7 +175,8 @@ void UTChemWellReader::readHeader()
 
     wellName.clear();
     dataLabel.clear();
-    data.clear();
+    columns.clear();
+    valueCount = 0;
 }
 
 // Reads a UTChem data file
@@ -222,11 +219,11 @@ int UTChemWellReader::parseAsWellHistoryData(const char *c_str)
     int read = sscanf(c_str, " HISTORY DATA FOR WELL: ID = %i IFLAG = %i NAME = %99s ", &a, &b, &name[0]);
 
     if (read != 3) {
-        vtkErrorMacro(<<"Unexpected history data format");
+        vtkDecodeErrorMacro(<<"Unexpected history data format");
         return 0;
     }
 
-    name = name.substr(name.find_last_not_of(" "));
+    name.resize(strlen(name.c_str())); // up to the terminator written by sscanf
 
     wellId = a;
     wellType = b;
@@ -244,22 +241,30 @@ int UTChemWellReader::parseAsWellVariables(const char* c_str)
         return parseAsProducerVariable();
     }
     else {
-        vtkErrorMacro(<<"Unknown well Type."<<wellType<<": Expected 1,2,3 or 4.");
+        vtkDecodeErrorMacro(<<"Unknown well Type."<<wellType<<": Expected 1,2,3 or 4.");
     return 0;
     }
 }
 
+// Comma separated values, a row of varCount values may span several lines.
+// Each value goes straight to the column of its variable.
 int UTChemWellReader::parseAsWellTable(const char* c_str)
 {
-    std::string token;
-    std::stringstream line(c_str);
-    float f;
-    std::stringstream ss;
-    while (std::getline(line, token , ',')) {
-        ss.str(token);
-        ss >> f;
-        data.push_back(f);
-        ss.clear();
+    const char* end = c_str + strlen(c_str);
+    const char* p = c_str;
+    while (p < end) {
+        const char* comma = (const char*) memchr(p, ',', end - p);
+        const char* fieldEnd = comma ? comma : end;
+        if (scanSkipSpace(p, fieldEnd) < fieldEnd) {
+            float f;
+            bool isNumber;
+            scanFloat(p, fieldEnd, f, isNumber);
+            if (varCount > 0) {
+                columns[valueCount % varCount].push_back(f);
+            }
+            valueCount++;
+        }
+        p = comma ? comma + 1 : end;
     }
     return 1;
 }
@@ -269,10 +274,20 @@ int UTChemWellReader::parseAsEndVarSection(const char* c_str)
     varCount = 0;
     int read = sscanf(c_str, " TOTAL NO. OF VARIABLES FOR %*s %*s %*s %*s %i ", &varCount);
 
-    if (1 != read) {
-        vtkErrorMacro(<<"Unexpected variable count format");
+    if (1 != read || varCount < 0) {
+        vtkDecodeErrorMacro(<<"Unexpected variable count format");
         return 0;
     }
+
+    // The rest of the file is the table, roughly 12 characters per value
+    size_t rows = 0;
+    if (varCount > 0 && cursor) {
+        rows = (size_t)(mappedFile.end() - cursor) / (12 * varCount) + 1;
+    }
+    columns.assign(varCount, std::vector<float>());
+    for (int i = 0; i < varCount; i++) {
+        columns[i].reserve(rows);
+    }
     return 1;
 }
 
@@ -314,7 +329,7 @@ int UTChemWellReader::parseAsProducerVariable()
         else if (contains(line, "PHASE CUTS FOR EACH PHASE")) {
             phaseCount = getVarRange(line);
             if (phaseCount < 3 || phaseCount > 4) {
-                vtkErrorMacro(<<"Unexpected phase cuts format");
+                vtkDecodeErrorMacro(<<"Unexpected phase cuts format");
                 return 0;
             }
             dataLabel.push_back("Phase Cut Water");
@@ -326,7 +341,7 @@ int UTChemWellReader::parseAsProducerVariable()
         }
         else if (contains(line, "WELLBORE PRESSURE OF EACH WELLBLOCK")) {
             if ((wellBlockCount = getVarRange(line)) < 1) {
-                vtkErrorMacro(<<"Unexpected wellbore pressure format");
+                vtkDecodeErrorMacro(<<"Unexpected wellbore pressure format");
                 return 0;
             }
             for (int i = 0; i < wellBlockCount; i++) {
@@ -347,7 +362,7 @@ int UTChemWellReader::parseAsProducerVariable()
             // The label we need is 13 characters after COMPONENT...
             char * component = strstr((char*)line, "COMPONENT");
             if (component == NULL || strlen(component) < 15 || component[12] != ' ') { 
-                vtkErrorMacro(<<"Unexpected component format");
+                vtkDecodeErrorMacro(<<"Unexpected component format");
                 return 0;
             } 
             component += 13; //assuming format "PHASE AND TOTAL CONC. FOR COMPONENT 1  WATER  "
@@ -379,7 +394,7 @@ int UTChemWellReader::parseAsProducerVariable()
         }
         else if (contains(line, "CAQSP(KK) FOR KK=1,NIAQ")) {
             if ( (niaq = getVarRange(line)) < 1 ) {
-                vtkErrorMacro(<<"Unexpected CAQSP format");
+                vtkDecodeErrorMacro(<<"Unexpected CAQSP format");
                 return 0;
             }
             for (int i = 0; i < niaq; i++) {
@@ -390,7 +405,7 @@ int UTChemWellReader::parseAsProducerVariable()
         }
         else if (contains(line, "CAQSP(KK) FOR KK=NIAQ+1,NFLD")) {
             if ( (nfld = niaq + getVarRange(line)) <= niaq ) {
-                vtkErrorMacro(<<"Unexpected CAQSP format");
+                vtkDecodeErrorMacro(<<"Unexpected CAQSP format");
                 return 0;
             }
             for (int i = niaq; i < nfld; i++) {
@@ -407,7 +422,7 @@ int UTChemWellReader::parseAsProducerVariable()
         }
         else if (contains(line, "CSLDT(KK),KK=1,NSLD")) {
             if ( (nsld = getVarRange(line)) < 1) {
-                vtkErrorMacro(<<"Unexpected CSLDT format");
+                vtkDecodeErrorMacro(<<"Unexpected CSLDT format");
                 return 0;
             }
             for (int i = 0; i < nsld; i++) {
@@ -425,7 +440,7 @@ int UTChemWellReader::parseAsProducerVariable()
             return parseAsEndVarSection(line);
         }
         else {
-            vtkErrorMacro(<<"Unexpected producer variable format");
+            vtkDecodeErrorMacro(<<"Unexpected producer variable format");
             return 0;
         }
     }
@@ -448,7 +463,7 @@ int UTChemWellReader::parseAsInjectorVariable()
         }
         else if (contains(line, "WELLBORE PRESSURE FOR EACH WELLBLOCK")) {
             if ((wellBlockCount = getVarRange(line)) < 0) {
-                vtkErrorMacro(<<"Unexpected wellbore pressure format");
+                vtkDecodeErrorMacro(<<"Unexpected wellbore pressure format");
                 return 0;
             }
 
@@ -469,7 +484,7 @@ int UTChemWellReader::parseAsInjectorVariable()
             return parseAsEndVarSection(line);
         }
         else {
-            vtkErrorMacro(<<"Unexpected injector variable format");
+            vtkDecodeErrorMacro(<<"Unexpected injector variable format");
             return 0;
         }
     }
@@ -482,13 +497,14 @@ bool UTChemWellReader::validFileRead()
     bool divisible = false;
 
     if (varCount != 0) {
-        if (data.size() % varCount == 0) {
+        // a running simulation may not have written the whole row yet
+        if (valueCount % varCount == 0 || FollowFile) {
             divisible = true;
         }
     }
 
     if (divisible) {
-        timeStepCount = (int)data.size()/varCount;
+        timeStepCount = (int)(valueCount/varCount);
         return 1;
     }
 
@@ -512,13 +528,9 @@ void UTChemWellReader::buildWell(vtkPolyData* data)
     int numPts = well.ilast - well.ifirst + 1;
 
     if (InputInfo->getObjectType() == 2) {
-        vtkSmartPointer<vtkStructuredGrid> sgrid = vtkSmartPointer<vtkStructuredGrid>::New();
-        sgrid->SetDimensions(InputInfo->nx + 1, InputInfo->ny + 1, InputInfo->nz + 1);
-        sgrid->SetPoints(InputInfo->points);
-        vtkSmartPointer<vtkCellCenters> centers = vtkSmartPointer<vtkCellCenters>::New();
-        centers->SetInput(sgrid);
-        centers->Update();
-        int index;
+        // Only the centers of the cells on the well path are computed (and cached by the deck)
+        double center[3];
+        int index = -1;
         if (numPts > 1) {
             // Curvilinear (vtkStructuredGrid) with well that extends multiple cells.
             for (int i = well.ifirst - 1; i < well.ilast; ++i) {
@@ -534,7 +546,11 @@ void UTChemWellReader::buildWell(vtkPolyData* data)
                     // Parallel to Z
                     index = (well.iw - 1) + InputInfo->nx * (well.jw - 1) + (InputInfo->nx * InputInfo->ny * i);
                 }
-                points->InsertNextPoint(centers->GetOutput()->GetPoints()->GetPoint(index));
+                if (!InputInfo->getCellCenter(index, center)) {
+                    vtkErrorMacro(<<"Well block outside of the grid");
+                    return;
+                }
+                points->InsertNextPoint(center);
                 line->GetPointIds()->InsertNextId(id++);
                 connectivity->InsertNextCell(line);
             }
@@ -551,7 +567,11 @@ void UTChemWellReader::buildWell(vtkPolyData* data)
             else if (well.idir == 3) {
                 index = (well.iw - 1) + InputInfo->nx * (well.jw - 1) + InputInfo->nx * InputInfo->ny * (well.ifirst - 1);
             }
-            points->InsertNextPoint(centers->GetOutput()->GetPoints()->GetPoint(index));
+            if (!InputInfo->getCellCenter(index, center)) {
+                vtkErrorMacro(<<"Well block outside of the grid");
+                return;
+            }
+            points->InsertNextPoint(center);
             vertex->GetPointIds()->InsertNextId(0);
             connectivity->InsertNextCell(vertex);
             data->SetVerts(connectivity); 
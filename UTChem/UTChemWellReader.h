@@ -55,6 +55,8 @@ private:
   UTChemWellReader(const UTChemWellReader&); // Not implemented.
   void operator=(const UTChemWellReader&); // Not implemented.
 
+  friend class UTChemWellSetReader; // drives many readers at once
+
 
   // internal functions for readFile and parseLine
   // Warning - readHeader is called by the constructor
@@ -93,7 +95,8 @@ private:
   std::string wellName;
 
   std::vector<std::string> dataLabel; // name of data
-  std::vector<float> data; // data, read in sequence of appearance
+  std::vector<std::vector<float> > columns; // one per variable, filled row by row
+  size_t valueCount; // number of table values read, including those of a partial row
 
   //ETX
 };
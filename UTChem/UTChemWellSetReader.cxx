@@ -0,0 +1,312 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemWellSetReader
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Li, D McWherter
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+// Include our header
+#include "UTChemWellSetReader.h"
+#include "UTChemWellReader.h"
+#include "UTChemInputReader.h"
+
+// Standard libraries
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <map>
+
+// Useful vtk/paraview headers
+#include "vtkCompositeDataSet.h"
+#include "vtkDirectory.h"
+#include "vtkFloatArray.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkIntArray.h"
+#include "vtkMultiBlockDataSet.h"
+#include "vtkMutexLock.h"
+#include "vtkObjectFactory.h"
+#include "vtkPolyData.h"
+#include "vtkStringArray.h"
+#include "vtkTable.h"
+#include <RVA_Util.h>
+
+// --------------------------------------------------------
+vtkStandardNewMacro(UTChemWellSetReader);
+
+UTChemWellSetReader::UTChemWellSetReader() : DirectoryName(NULL), NumberOfThreads(0)
+{
+    this->SetNumberOfInputPorts(0);
+    this->SetNumberOfOutputPorts(2);
+}
+
+UTChemWellSetReader::~UTChemWellSetReader()
+{
+    this->SetDirectoryName(NULL);
+}
+
+void UTChemWellSetReader::PrintSelf(ostream& os, vtkIndent indent)
+{
+    os << indent << "Directory name: " << (DirectoryName ? DirectoryName : "(none)") << "\n";
+    os << indent << "NumberOfThreads: " << NumberOfThreads << "\n";
+    Superclass::PrintSelf(os, indent);
+}
+
+int UTChemWellSetReader::FillOutputPortInformation(int port, vtkInformation* info)
+{
+    if (port == 1) {
+        info->Set(vtkDataObject::DATA_TYPE_NAME(), "vtkTable");
+    }
+    else {
+        info->Set(vtkDataObject::DATA_TYPE_NAME(), "vtkMultiBlockDataSet");
+    }
+    return 1;
+}
+
+int UTChemWellSetReader::RequestData(vtkInformation* vtkNotUsed(request),
+                                       vtkInformationVector** vtkNotUsed(inputVector),
+                                       vtkInformationVector* outputVector)
+{
+    vtkMultiBlockDataSet* wells = vtkMultiBlockDataSet::SafeDownCast(
+        outputVector->GetInformationObject(0)->Get(vtkDataObject::DATA_OBJECT()));
+    vtkTable* table = vtkTable::SafeDownCast(
+        outputVector->GetInformationObject(1)->Get(vtkDataObject::DATA_OBJECT()));
+
+    if (!DirectoryName || !wells || !table) {
+        return 0;
+    }
+
+    std::vector<std::string> files = findHistoryFiles();
+    if (files.empty()) {
+        vtkErrorMacro(<<"No HIST files found in " << DirectoryName);
+        return 0;
+    }
+
+    // Parse INPUT once here, the well readers then get the deck from the registry
+    UTChemInputReader* deck = UTChemInputReader::acquire(UTChemWellReader::getInputFileFromFileName(files[0].c_str()));
+
+    std::vector<UTChemWellReader*> readers;
+    for (size_t i = 0; i < files.size(); i++) {
+        UTChemWellReader* reader = UTChemWellReader::New();
+        reader->SetFileName(files[i].c_str());
+        reader->reloadInputFile(files[i].c_str());
+        readers.push_back(reader);
+    }
+
+    std::vector<int> parsed(readers.size(), 0);
+    parseFiles(readers, parsed);
+    this->UpdateProgress(0.9);
+
+    // Positions are built here rather than on the workers, the cell centers of the deck are computed lazily
+    wells->SetNumberOfBlocks((unsigned) readers.size());
+    for (size_t i = 0; i < readers.size(); i++) {
+        UTChemWellReader* reader = readers[i];
+        std::string label = reader->wellName.empty() ? reader->file_ext : reader->wellName;
+        int fileWellId = atoi(reader->file_ext.substr(4, 2).c_str());
+
+        if (!parsed[i]) {
+            vtkWarningMacro(<<"Skipping " << files[i] << ", it could not be parsed");
+        }
+        else if (!reader->InputInfo || !reader->InputInfo->wellInfo.count(fileWellId)) {
+            vtkWarningMacro(<<"Well " << fileWellId << " of " << files[i] << " is not defined in INPUT");
+        }
+        else {
+            vtkPolyData* well = vtkPolyData::New();
+            reader->buildWell(well);
+            wells->SetBlock((unsigned) i, well);
+            well->Delete();
+        }
+        wells->GetMetaData((unsigned) i)->Set(vtkCompositeDataSet::NAME(), label.c_str());
+    }
+
+    buildHistoryTable(table, readers, parsed);
+
+    for (size_t i = 0; i < readers.size(); i++) {
+        readers[i]->Delete();
+    }
+    UTChemInputReader::release(deck);
+
+    this->UpdateProgress(1.0);
+    return 1;
+}
+
+// HIST01..HIST99, the plain HIST file has no well number and no position
+std::vector<std::string> UTChemWellSetReader::findHistoryFiles()
+{
+    std::vector<std::string> files;
+    vtkDirectory* dir = vtkDirectory::New();
+    if (!dir->Open(DirectoryName)) {
+        vtkErrorMacro(<<"Could not open directory " << DirectoryName);
+        dir->Delete();
+        return files;
+    }
+
+    std::string prefix(DirectoryName);
+#ifdef _WIN32
+    const char separator = '\\';
+#else
+    const char separator = '/';
+#endif
+    if (!prefix.empty() && prefix[prefix.length() - 1] != separator) {
+        prefix += separator;
+    }
+
+    for (vtkIdType i = 0; i < dir->GetNumberOfFiles(); i++) {
+        const char* name = dir->GetFile(i);
+        if (!strchr(name, '.')) {
+            continue;
+        }
+        std::string ext = getFileExtension(name);
+        if (ext.length() == 6 && ext.substr(0, 4) == "HIST" && isdigit(ext[4]) && isdigit(ext[5])) {
+            files.push_back(prefix + name);
+        }
+    }
+    dir->Delete();
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+struct UTChemWellSetJob
+{
+    std::vector<UTChemWellReader*>* readers;
+    std::vector<int>* parsed;
+    size_t next; // next file to hand out
+    vtkMutexLock* lock;
+};
+
+// Files are handed out one at a time, wells differ a lot in the length of their history
+VTK_THREAD_RETURN_TYPE UTChemWellSetReader::ParseFilesThread(void* arg)
+{
+    vtkMultiThreader::ThreadInfo* info = static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+    UTChemWellSetJob* job = static_cast<UTChemWellSetJob*>(info->UserData);
+
+    while (true) {
+        job->lock->Lock();
+        size_t i = job->next++;
+        job->lock->Unlock();
+
+        if (i >= job->readers->size()) {
+            break;
+        }
+        (*job->parsed)[i] = (*job->readers)[i]->readFile();
+    }
+    return VTK_THREAD_RETURN_VALUE;
+}
+
+void UTChemWellSetReader::parseFiles(std::vector<UTChemWellReader*>& readers, std::vector<int>& parsed)
+{
+    int threads = NumberOfThreads > 0 ? NumberOfThreads : vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+    threads = std::max(1, std::min(threads, (int) readers.size()));
+
+    UTChemWellSetJob job;
+    job.readers = &readers;
+    job.parsed = &parsed;
+    job.next = 0;
+    job.lock = vtkMutexLock::New();
+
+    // The workers must not use the output window, their readers keep the messages
+    for (size_t i = 0; i < readers.size(); i++) {
+        readers[i]->SetDebug(0);
+        readers[i]->deferMessages = true;
+    }
+
+    vtkMultiThreader* threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(threads);
+    threader->SetSingleMethod(ParseFilesThread, &job);
+    threader->SingleMethodExecute();
+    threader->Delete();
+    job.lock->Delete();
+
+    // Reported per file and in file order, independent of thread scheduling
+    for (size_t i = 0; i < readers.size(); i++) {
+        UTChemWellReader* reader = readers[i];
+        for (size_t m = 0; m < reader->deferredMessages.size(); m++) {
+            if (reader->deferredMessages[m].first) {
+                vtkErrorMacro(<< reader->GetFileName() << ": " << reader->deferredMessages[m].second);
+            }
+        }
+        reader->deferredMessages.clear();
+        reader->deferMessages = false;
+    }
+}
+
+// Rows of all wells one after the other. Injectors and producers report
+// different variables, so the columns are the union of all variables in
+// order of appearance and hold NaN where a well lacks the variable.
+void UTChemWellSetReader::buildHistoryTable(vtkTable* table, std::vector<UTChemWellReader*>& readers, std::vector<int>& parsed)
+{
+    std::vector<std::string> labels;
+    std::map<std::string, int> labelColumn;
+    vtkIdType rows = 0;
+    for (size_t i = 0; i < readers.size(); i++) {
+        if (!parsed[i]) {
+            continue;
+        }
+        for (size_t v = 0; v < readers[i]->dataLabel.size(); v++) {
+            const std::string& label = readers[i]->dataLabel[v];
+            if (!labelColumn.count(label)) {
+                labelColumn[label] = (int) labels.size();
+                labels.push_back(label);
+            }
+        }
+        rows += readers[i]->timeStepCount;
+    }
+
+    vtkStringArray* wellNames = vtkStringArray::New();
+    wellNames->SetName("Well");
+    wellNames->SetNumberOfValues(rows);
+    vtkIntArray* wellIds = vtkIntArray::New();
+    wellIds->SetName("Well ID");
+    wellIds->SetNumberOfValues(rows);
+
+    std::vector<vtkFloatArray*> columns(labels.size());
+    for (size_t c = 0; c < labels.size(); c++) {
+        columns[c] = vtkFloatArray::New();
+        columns[c]->SetName(labels[c].c_str());
+        columns[c]->SetNumberOfTuples(rows);
+        if (rows > 0) {
+            std::fill(columns[c]->GetPointer(0), columns[c]->GetPointer(0) + rows, std::numeric_limits<float>::quiet_NaN());
+        }
+    }
+
+    vtkIdType first = 0;
+    for (size_t i = 0; i < readers.size(); i++) {
+        UTChemWellReader* reader = readers[i];
+        if (!parsed[i]) {
+            continue;
+        }
+        const int count = reader->timeStepCount;
+        std::string label = reader->wellName.empty() ? reader->file_ext : reader->wellName;
+        for (int r = 0; r < count; r++) {
+            wellNames->SetValue(first + r, label.c_str());
+            wellIds->SetValue(first + r, reader->wellId);
+        }
+        for (size_t v = 0; v < reader->dataLabel.size() && v < reader->columns.size(); v++) {
+            if (count > 0) {
+                memcpy(columns[labelColumn[reader->dataLabel[v]]]->GetPointer(first), &reader->columns[v][0], count * sizeof(float));
+            }
+        }
+        first += count;
+    }
+
+    table->AddColumn(wellNames);
+    wellNames->Delete();
+    table->AddColumn(wellIds);
+    wellIds->Delete();
+    for (size_t c = 0; c < columns.size(); c++) {
+        table->AddColumn(columns[c]);
+        columns[c]->Delete();
+    }
+}
@@ -0,0 +1,81 @@
+/*=========================================================================
+
+Program:   RVA
+Module:    UTChemWellSetReader
+
+Copyright (c) University of Illinois at Urbana-Champaign (UIUC)
+Original Authors: L Angrave, J Li, D McWherter
+
+All rights reserved.
+See Copyright.txt for details.
+
+This software is distributed WITHOUT ANY WARRANTY; without even
+the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+// Reads every HISTnn file of a UTChem run at once. The files are parsed
+// in parallel by UTChemWellReaders that share one INPUT deck.
+// Output 0 is a multiblock with the position of each well, output 1 the
+// histories of all wells stacked into one table; the first two columns
+// name the well each row belongs to.
+
+#ifndef __UTChemWellSetReader_h
+#define __UTChemWellSetReader_h
+
+#include "vtkMultiBlockDataSetAlgorithm.h"
+#include "vtkMultiThreader.h"
+
+#include <vector>
+#include <string>
+
+class vtkTable;
+class vtkMutexLock;
+class UTChemWellReader;
+
+class VTK_EXPORT UTChemWellSetReader : public vtkMultiBlockDataSetAlgorithm {
+public:
+    static UTChemWellSetReader* New();
+    vtkTypeMacro(UTChemWellSetReader, vtkMultiBlockDataSetAlgorithm);
+    virtual void PrintSelf(ostream& os, vtkIndent indent);
+
+    // Description:
+    // Directory of the run, holding the INPUT file and the HIST files.
+    vtkSetStringMacro(DirectoryName);
+    vtkGetStringMacro(DirectoryName);
+
+    // Description:
+    // Number of HIST files parsed at the same time. 0 (the default) uses
+    // one thread per processor.
+    vtkSetClampMacro(NumberOfThreads, int, 0, VTK_MAX_THREADS);
+    vtkGetMacro(NumberOfThreads, int);
+
+protected:
+    UTChemWellSetReader();
+    virtual ~UTChemWellSetReader();
+
+    int FillOutputPortInformation(int port, vtkInformation* info);
+
+    int RequestData(
+        vtkInformation* request,
+        vtkInformationVector** inputVector,
+        vtkInformationVector* outputVector);
+
+    char* DirectoryName;
+    int NumberOfThreads;
+
+private:
+    //BTX
+    UTChemWellSetReader(const UTChemWellSetReader&); // Not implemented.
+    void operator=(const UTChemWellSetReader&); // Not implemented.
+
+    std::vector<std::string> findHistoryFiles(); // sorted full paths of the HISTnn files
+    void parseFiles(std::vector<UTChemWellReader*>& readers, std::vector<int>& parsed);
+    void buildHistoryTable(vtkTable* table, std::vector<UTChemWellReader*>& readers, std::vector<int>& parsed);
+
+    static VTK_THREAD_RETURN_TYPE ParseFilesThread(void* arg);
+    //ETX
+};
+
+#endif // __UTChemWellSetReader_h